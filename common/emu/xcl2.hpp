@@ -0,0 +1,677 @@
+/*******************************************************************************
+Description:
+   Software-emulated device backend. Drop-in replacement for the subset of
+   xcl2.hpp / cl2.hpp that the host programs in this repository use, so
+   the host side (scheduling, partitioning, P2P I/O) builds and runs on any
+   Linux box without an FPGA, an xclbin or XRT.
+
+   Put this directory in front of the Vitis xcl2 include path and link the
+   kernel sources plus the example's emu_kernels.cpp into the host binary,
+   the kernels then run as plain C++ on worker threads :
+
+       g++ -O2 -std=c++17 -Icommon/emu -I<vitis>/common/includes/cmdparser \
+           -I<vitis>/common/includes/logger pagerank/host.cpp \
+           pagerank/cu3_pagerank*.cpp pagerank/emu_kernels.cpp \
+           <vitis>/common/includes/cmdparser/cmdlineparser.cpp \
+           <vitis>/common/includes/logger/logger.cpp -pthread -fopenmp
+
+   Semantics kept from the real runtime :
+     - CL_MEM_USE_HOST_PTR buffers have separate device storage, data only
+       moves on enqueueMigrateMemObjects / Read / Write / Map / Unmap, so a
+       missing migrate shows up as wrong results just like on the card.
+     - Commands run on worker threads. An in-order queue chains every
+       command after the previous one, an out-of-order queue only honours
+       the event wait lists. Events report CL_EVENT_COMMAND_EXECUTION_STATUS
+       and carry QUEUED / SUBMIT / START / END profiling timestamps (ns).
+     - Kernels are found by name and CL_KERNEL_COMPUTE_UNIT_COUNT returns
+       the count given at registration. "name:{name_N}" binds the kernel to
+       instance N of its program : tasks on one instance run one at a time
+       in enqueue order, across all queues, like on the card. A plain
+       "name" may run on any instance, its tasks are not serialized.
+     - Buffers and sub-buffers of size 0 fail with CL_INVALID_BUFFER_SIZE.
+     - XCL_MEM_EXT_P2P_BUFFER buffers map straight onto device storage, so
+       pread() / pwrite() on a plain local file stand in for SSD P2P.
+
+   Environment :
+     XCL_EMU_DEVICES   number of devices returned by get_xil_devices() (1)
+     XCL_EMU_THREADS   worker threads shared by all queues (hardware
+                       concurrency, at least 4)
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint64_t cl_ulong;
+typedef cl_uint cl_bool;
+typedef cl_ulong cl_mem_flags;
+typedef cl_ulong cl_map_flags;
+typedef cl_ulong cl_mem_migration_flags;
+typedef cl_ulong cl_command_queue_properties;
+typedef cl_uint cl_buffer_create_type;
+
+#define CL_SUCCESS 0
+#define CL_DEVICE_NOT_FOUND -1
+#define CL_MEM_OBJECT_ALLOCATION_FAILURE -4
+#define CL_INVALID_VALUE -30
+#define CL_INVALID_MEM_OBJECT -38
+#define CL_INVALID_PROGRAM -44
+#define CL_INVALID_KERNEL_NAME -46
+#define CL_INVALID_ARG_INDEX -49
+#define CL_INVALID_BUFFER_SIZE -61
+
+#define CL_FALSE 0
+#define CL_TRUE 1
+
+#define CL_MEM_READ_WRITE (1 << 0)
+#define CL_MEM_WRITE_ONLY (1 << 1)
+#define CL_MEM_READ_ONLY (1 << 2)
+#define CL_MEM_USE_HOST_PTR (1 << 3)
+#define CL_MEM_ALLOC_HOST_PTR (1 << 4)
+#define CL_MEM_COPY_HOST_PTR (1 << 5)
+#define CL_MEM_EXT_PTR_XILINX (1u << 31)
+
+#define XCL_MEM_EXT_P2P_BUFFER (1u << 30)
+
+#define CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE (1 << 0)
+#define CL_QUEUE_PROFILING_ENABLE (1 << 1)
+
+#define CL_MIGRATE_MEM_OBJECT_HOST (1 << 0)
+#define CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED (1 << 1)
+
+#define CL_MAP_READ (1 << 0)
+#define CL_MAP_WRITE (1 << 1)
+
+#define CL_DEVICE_NAME 0x102B
+#define CL_BUFFER_CREATE_TYPE_REGION 0x1220
+#define CL_PROFILING_COMMAND_QUEUED 0x1280
+#define CL_PROFILING_COMMAND_SUBMIT 0x1281
+#define CL_PROFILING_COMMAND_START 0x1282
+#define CL_PROFILING_COMMAND_END 0x1283
+#define CL_EVENT_COMMAND_EXECUTION_STATUS 0x11D3
+#define CL_COMPLETE 0x0
+#define CL_RUNNING 0x1
+#define CL_KERNEL_COMPUTE_UNIT_COUNT 0x4040
+
+typedef struct {
+    unsigned flags;
+    void* obj;
+    void* param;
+} cl_mem_ext_ptr_t;
+
+typedef struct {
+    size_t origin;
+    size_t size;
+} cl_buffer_region;
+
+#define OCL_CHECK(error, call)                                                                   \
+    call;                                                                                        \
+    if (error != CL_SUCCESS) {                                                                   \
+        printf("%s:%d Error calling " #call ", error code is: %d\n", __FILE__, __LINE__, error); \
+        exit(EXIT_FAILURE);                                                                      \
+    }
+
+template <typename T>
+struct aligned_allocator {
+    using value_type = T;
+
+    aligned_allocator() = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U>&) {}
+
+    T* allocate(std::size_t num) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, 4096, num ? num * sizeof(T) : 4096)) throw std::bad_alloc();
+        return reinterpret_cast<T*>(ptr);
+    }
+    void deallocate(T* p, std::size_t) { free(p); }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const aligned_allocator<U>&) const { return false; }
+};
+
+namespace emu {
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct EventImpl {
+    std::mutex m;
+    std::condition_variable cv;
+    bool done = false;
+    uint64_t queued = 0, submit = 0, start = 0, end = 0;
+
+    void wait() {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [this] { return done; });
+    }
+    void complete() {
+        std::lock_guard<std::mutex> lk(m);
+        done = true;
+        cv.notify_all();
+    }
+};
+
+struct BufferImpl {
+    std::shared_ptr<BufferImpl> parent;
+    size_t offset = 0;
+    size_t size = 0;
+    cl_mem_flags flags = 0;
+    bool p2p = false;
+    char* host_ptr = nullptr;
+    char* storage = nullptr;
+
+    ~BufferImpl() {
+        if (!parent) free(storage);
+    }
+    char* device() { return storage; }
+};
+
+// One scalar or buffer kernel argument, captured by value at enqueue time.
+struct ArgValue {
+    std::shared_ptr<BufferImpl> buffer;
+    std::vector<char> bytes;
+
+    void* ptr() const { return buffer ? buffer->device() : nullptr; }
+};
+
+using Invoker = std::function<void(const std::vector<ArgValue>&)>;
+
+struct KernelEntry {
+    Invoker invoke;
+    size_t num_args;
+    cl_uint num_cu;
+};
+
+inline std::map<std::string, KernelEntry>& registry() {
+    static std::map<std::string, KernelEntry> r;
+    return r;
+}
+
+template <typename T>
+T arg_cast(const ArgValue& a) {
+    if (std::is_pointer<T>::value) {
+        void* p = a.ptr();
+        T out;
+        std::memcpy(&out, &p, sizeof(T));
+        return out;
+    }
+    T out{};
+    std::memcpy(&out, a.bytes.data(), std::min(sizeof(T), a.bytes.size()));
+    return out;
+}
+
+template <typename... A, size_t... I>
+void invoke(void (*fn)(A...), const std::vector<ArgValue>& args, std::index_sequence<I...>) {
+    fn(arg_cast<typename std::decay<A>::type>(args[I])...);
+}
+
+// Registers a C kernel under its xclbin name. num_cu mirrors the number of
+// instances the real link step would create for it.
+template <typename... A>
+bool register_kernel(const std::string& name, void (*fn)(A...), cl_uint num_cu = 1) {
+    registry()[name] = {[fn](const std::vector<ArgValue>& args) { invoke(fn, args, std::index_sequence_for<A...>{}); },
+                        sizeof...(A), num_cu};
+    return true;
+}
+
+// FIFO worker pool. Every command waits for its dependencies on the worker
+// that picked it up; dependencies are always submitted earlier, so the
+// oldest unfinished command can always make progress.
+class Scheduler {
+   public:
+    explicit Scheduler(unsigned threads) {
+        for (unsigned i = 0; i < threads; i++) workers_.emplace_back([this] { loop(); });
+    }
+    ~Scheduler() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+    static Scheduler& get() {
+        static unsigned threads = [] {
+            const char* env = std::getenv("XCL_EMU_THREADS");
+            unsigned n = env ? std::atoi(env) : std::thread::hardware_concurrency();
+            return std::max(4u, n);
+        }();
+        static Scheduler s(threads);
+        return s;
+    }
+
+   private:
+    void loop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                cv_.wait(lk, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()> > tasks_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+};
+
+// The ordering chain of one compute unit instance
+struct ComputeUnit {
+    std::mutex m;
+    std::shared_ptr<EventImpl> last;
+};
+
+struct ProgramImpl {
+    std::mutex m;
+    std::map<std::string, std::shared_ptr<ComputeUnit> > units;
+};
+
+struct QueueImpl {
+    bool in_order = true;
+    std::mutex m;
+    std::shared_ptr<EventImpl> last;
+    std::vector<std::shared_ptr<EventImpl> > outstanding;
+};
+
+} // namespace emu
+
+namespace cl {
+
+class Device {
+   public:
+    Device() = default;
+    explicit Device(int index) : index_(index) {}
+
+    template <cl_int name>
+    std::string getInfo(cl_int* err = nullptr) const {
+        if (err) *err = CL_SUCCESS;
+        return "xilinx_emu_device_" + std::to_string(index_);
+    }
+    int index() const { return index_; }
+
+   private:
+    int index_ = 0;
+};
+
+class Context {
+   public:
+    Context() = default;
+    Context(const Device& device, void*, void*, void*, cl_int* err) : device_(device) {
+        if (err) *err = CL_SUCCESS;
+    }
+    const Device& device() const { return device_; }
+
+   private:
+    Device device_;
+};
+
+class Program {
+   public:
+    typedef std::vector<std::pair<const void*, size_t> > Binaries;
+
+    Program() = default;
+    Program(const Context&, const std::vector<Device>&, const Binaries&, std::vector<cl_int>* = nullptr,
+            cl_int* err = nullptr)
+        : impl_(std::make_shared<emu::ProgramImpl>()) {
+        if (err) *err = CL_SUCCESS;
+    }
+
+    std::shared_ptr<emu::ProgramImpl> impl_;
+};
+
+class Event {
+   public:
+    Event() = default;
+
+    cl_int wait() const {
+        if (impl_) impl_->wait();
+        return CL_SUCCESS;
+    }
+    template <typename T>
+    cl_int getInfo(cl_int name, T* param) const {
+        if (!impl_ || name != CL_EVENT_COMMAND_EXECUTION_STATUS) return CL_INVALID_VALUE;
+        std::lock_guard<std::mutex> lk(impl_->m);
+        *param = impl_->done ? CL_COMPLETE : CL_RUNNING;
+        return CL_SUCCESS;
+    }
+    static cl_int waitForEvents(const std::vector<Event>& events) {
+        for (auto& e : events) e.wait();
+        return CL_SUCCESS;
+    }
+    template <typename T>
+    cl_int getProfilingInfo(cl_int name, T* param) const {
+        if (!impl_) return CL_INVALID_VALUE;
+        impl_->wait();
+        switch (name) {
+            case CL_PROFILING_COMMAND_QUEUED: *param = impl_->queued; break;
+            case CL_PROFILING_COMMAND_SUBMIT: *param = impl_->submit; break;
+            case CL_PROFILING_COMMAND_START: *param = impl_->start; break;
+            case CL_PROFILING_COMMAND_END: *param = impl_->end; break;
+            default: return CL_INVALID_VALUE;
+        }
+        return CL_SUCCESS;
+    }
+
+    std::shared_ptr<emu::EventImpl> impl_;
+};
+
+class Memory {
+   public:
+    Memory() = default;
+    std::shared_ptr<emu::BufferImpl> impl_;
+};
+
+class Buffer : public Memory {
+   public:
+    Buffer() = default;
+    Buffer(const Context&, cl_mem_flags flags, size_t size, void* host_ptr = nullptr, cl_int* err = nullptr) {
+        if (size == 0) {
+            if (err) *err = CL_INVALID_BUFFER_SIZE;
+            return;
+        }
+        impl_ = std::make_shared<emu::BufferImpl>();
+        impl_->size = size;
+        impl_->flags = flags;
+        if (flags & CL_MEM_EXT_PTR_XILINX) {
+            auto ext = static_cast<cl_mem_ext_ptr_t*>(host_ptr);
+            impl_->p2p = ext && (ext->flags & XCL_MEM_EXT_P2P_BUFFER);
+            host_ptr = ext ? ext->obj : nullptr;
+        }
+        if (posix_memalign(reinterpret_cast<void**>(&impl_->storage), 4096, size)) {
+            if (err) *err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+            return;
+        }
+        if (flags & CL_MEM_USE_HOST_PTR) impl_->host_ptr = static_cast<char*>(host_ptr);
+        if ((flags & CL_MEM_COPY_HOST_PTR) && host_ptr) std::memcpy(impl_->storage, host_ptr, size);
+        if (err) *err = CL_SUCCESS;
+    }
+
+    Buffer createSubBuffer(cl_mem_flags flags, cl_buffer_create_type, const void* info, cl_int* err = nullptr) {
+        auto region = static_cast<const cl_buffer_region*>(info);
+        Buffer sub;
+        if (region->size == 0) {
+            if (err) *err = CL_INVALID_BUFFER_SIZE;
+            return sub;
+        }
+        if (region->origin + region->size > impl_->size) {
+            if (err) *err = CL_INVALID_VALUE;
+            return sub;
+        }
+        sub.impl_ = std::make_shared<emu::BufferImpl>();
+        sub.impl_->parent = impl_;
+        sub.impl_->offset = region->origin;
+        sub.impl_->size = region->size;
+        sub.impl_->flags = flags | impl_->flags;
+        sub.impl_->p2p = impl_->p2p;
+        sub.impl_->storage = impl_->storage + region->origin;
+        sub.impl_->host_ptr = impl_->host_ptr ? impl_->host_ptr + region->origin : nullptr;
+        if (err) *err = CL_SUCCESS;
+        return sub;
+    }
+};
+
+class Kernel {
+   public:
+    Kernel() = default;
+    // "name" or "name:{name_N}", N from 1 to the compute unit count
+    Kernel(const Program& program, const char* name, cl_int* err = nullptr) {
+        std::string full(name);
+        size_t colon = full.find(':');
+        std::string n = full.substr(0, colon);
+        auto it = emu::registry().find(n);
+        if (it == emu::registry().end()) {
+            std::cerr << "[EMU] kernel " << n << " is not registered\n";
+            if (err) *err = CL_INVALID_KERNEL_NAME;
+            return;
+        }
+        if (colon != std::string::npos) {
+            if (!program.impl_) {
+                if (err) *err = CL_INVALID_PROGRAM;
+                return;
+            }
+            std::string prefix = ":{" + n + "_";
+            int index = 0;
+            if (full.compare(colon, prefix.size(), prefix) == 0 && full.back() == '}')
+                index = std::atoi(full.c_str() + colon + prefix.size());
+            if (index < 1 || index > (int)it->second.num_cu) {
+                std::cerr << "[EMU] kernel " << full << " names no instance of " << n << "\n";
+                if (err) *err = CL_INVALID_KERNEL_NAME;
+                return;
+            }
+            std::lock_guard<std::mutex> lk(program.impl_->m);
+            auto& cu = program.impl_->units[n + "_" + std::to_string(index)];
+            if (!cu) cu = std::make_shared<emu::ComputeUnit>();
+            cu_ = cu;
+        }
+        entry_ = &it->second;
+        args_ = std::make_shared<std::vector<emu::ArgValue> >(entry_->num_args);
+        if (err) *err = CL_SUCCESS;
+    }
+
+    cl_int setArg(cl_uint index, const Buffer& buffer) {
+        if (index >= args_->size()) return CL_INVALID_ARG_INDEX;
+        (*args_)[index].buffer = buffer.impl_;
+        return CL_SUCCESS;
+    }
+    template <typename T>
+    typename std::enable_if<!std::is_base_of<Memory, T>::value, cl_int>::type setArg(cl_uint index, const T& value) {
+        if (index >= args_->size()) return CL_INVALID_ARG_INDEX;
+        auto& a = (*args_)[index];
+        a.buffer.reset();
+        a.bytes.assign(reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + sizeof(T));
+        return CL_SUCCESS;
+    }
+    template <typename T>
+    cl_int getInfo(cl_int name, T* param) const {
+        if (name != CL_KERNEL_COMPUTE_UNIT_COUNT || !entry_) return CL_INVALID_VALUE;
+        *param = static_cast<T>(entry_->num_cu);
+        return CL_SUCCESS;
+    }
+
+    const emu::KernelEntry* entry_ = nullptr;
+    std::shared_ptr<std::vector<emu::ArgValue> > args_;
+    std::shared_ptr<emu::ComputeUnit> cu_; // null : any instance
+};
+
+class CommandQueue {
+   public:
+    CommandQueue() = default;
+    CommandQueue(const Context&, const Device&, cl_command_queue_properties props, cl_int* err = nullptr)
+        : impl_(std::make_shared<emu::QueueImpl>()) {
+        impl_->in_order = !(props & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+        if (err) *err = CL_SUCCESS;
+    }
+
+    cl_int enqueueMigrateMemObjects(const std::vector<Memory>& mems, cl_mem_migration_flags flags,
+                                    const std::vector<Event>* events = nullptr, Event* event = nullptr) const {
+        std::vector<std::shared_ptr<emu::BufferImpl> > bufs;
+        for (auto& m : mems) bufs.push_back(m.impl_);
+        return submit(events, event, false, [bufs, flags] {
+            if (flags & CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED) return;
+            for (auto& b : bufs) {
+                if (!b->host_ptr) continue;
+                if (flags & CL_MIGRATE_MEM_OBJECT_HOST)
+                    std::memcpy(b->host_ptr, b->device(), b->size);
+                else
+                    std::memcpy(b->device(), b->host_ptr, b->size);
+            }
+        });
+    }
+
+    cl_int enqueueTask(const Kernel& kernel, const std::vector<Event>* events = nullptr, Event* event = nullptr) const {
+        if (!kernel.entry_) return CL_INVALID_KERNEL_NAME;
+        auto invoke = kernel.entry_->invoke;
+        auto args = *kernel.args_;
+        return submit(events, event, false, [invoke, args] { invoke(args); }, kernel.cu_.get());
+    }
+
+    cl_int enqueueReadBuffer(const Buffer& buffer, cl_bool blocking, size_t offset, size_t size, void* ptr,
+                             const std::vector<Event>* events = nullptr, Event* event = nullptr) const {
+        auto b = buffer.impl_;
+        return submit(events, event, blocking,
+                      [b, offset, size, ptr] { std::memcpy(ptr, b->device() + offset, size); });
+    }
+
+    cl_int enqueueWriteBuffer(const Buffer& buffer, cl_bool blocking, size_t offset, size_t size, const void* ptr,
+                              const std::vector<Event>* events = nullptr, Event* event = nullptr) const {
+        auto b = buffer.impl_;
+        return submit(events, event, blocking,
+                      [b, offset, size, ptr] { std::memcpy(b->device() + offset, ptr, size); });
+    }
+
+    void* enqueueMapBuffer(const Buffer& buffer, cl_bool blocking, cl_map_flags, size_t offset, size_t size,
+                           const std::vector<Event>* events = nullptr, Event* event = nullptr,
+                           cl_int* err = nullptr) const {
+        auto b = buffer.impl_;
+        cl_int e = submit(events, event, blocking, [b, offset, size] {
+            if (b->host_ptr) std::memcpy(b->host_ptr + offset, b->device() + offset, size);
+        });
+        if (err) *err = e;
+        return b->host_ptr ? b->host_ptr + offset : b->device() + offset;
+    }
+
+    cl_int enqueueUnmapMemObject(const Memory& mem, void* mapped, const std::vector<Event>* events = nullptr,
+                                 Event* event = nullptr) const {
+        auto b = mem.impl_;
+        return submit(events, event, false, [b, mapped] {
+            if (b->host_ptr) {
+                size_t off = static_cast<char*>(mapped) - b->host_ptr;
+                std::memcpy(b->device() + off, mapped, b->size - off);
+            }
+        });
+    }
+
+    cl_int enqueueMarkerWithWaitList(const std::vector<Event>* events = nullptr, Event* event = nullptr) const {
+        return submit(events, event, false, [] {});
+    }
+
+    cl_int flush() const { return CL_SUCCESS; }
+
+    cl_int finish() const {
+        std::vector<std::shared_ptr<emu::EventImpl> > pending;
+        {
+            std::lock_guard<std::mutex> lk(impl_->m);
+            pending.swap(impl_->outstanding);
+        }
+        for (auto& e : pending) e->wait();
+        return CL_SUCCESS;
+    }
+
+   private:
+    // cu : the instance a task runs on, it starts after the previous task enqueued there
+    cl_int submit(const std::vector<Event>* events, Event* event, cl_bool blocking, std::function<void()> work,
+                  emu::ComputeUnit* cu = nullptr) const {
+        auto ev = std::make_shared<emu::EventImpl>();
+        ev->queued = emu::now_ns();
+        std::vector<std::shared_ptr<emu::EventImpl> > deps;
+        if (events)
+            for (auto& e : *events)
+                if (e.impl_) deps.push_back(e.impl_);
+        {
+            std::lock_guard<std::mutex> lk(impl_->m);
+            if (impl_->in_order && impl_->last) deps.push_back(impl_->last);
+            impl_->last = ev;
+            impl_->outstanding.erase(std::remove_if(impl_->outstanding.begin(), impl_->outstanding.end(),
+                                                    [](const std::shared_ptr<emu::EventImpl>& e) {
+                                                        std::lock_guard<std::mutex> l(e->m);
+                                                        return e->done;
+                                                    }),
+                                     impl_->outstanding.end());
+            impl_->outstanding.push_back(ev);
+        }
+        if (cu) {
+            std::lock_guard<std::mutex> lk(cu->m);
+            if (cu->last) deps.push_back(cu->last);
+            cu->last = ev;
+        }
+        emu::Scheduler::get().submit([ev, deps, work] {
+            for (auto& d : deps) d->wait();
+            ev->submit = emu::now_ns();
+            ev->start = emu::now_ns();
+            work();
+            ev->end = emu::now_ns();
+            ev->complete();
+        });
+        if (event) event->impl_ = ev;
+        if (blocking) ev->wait();
+        return CL_SUCCESS;
+    }
+
+    std::shared_ptr<emu::QueueImpl> impl_;
+};
+
+} // namespace cl
+
+namespace xcl {
+
+inline std::vector<cl::Device> get_xil_devices() {
+    const char* env = std::getenv("XCL_EMU_DEVICES");
+    int n = env ? std::atoi(env) : 1;
+    std::vector<cl::Device> devices;
+    for (int i = 0; i < n; i++) devices.emplace_back(i);
+    return devices;
+}
+
+inline cl::Device find_device_bdf(const std::vector<cl::Device>& devices, const std::string&) {
+    return devices.at(0);
+}
+
+inline std::vector<unsigned char> read_binary_file(const std::string& name) {
+    std::ifstream in(name, std::ifstream::binary);
+    if (!in) {
+        std::cout << "[EMU] " << name << " not found, using registered kernels only\n";
+        return std::vector<unsigned char>(1);
+    }
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+inline bool is_emulation() {
+    return true;
+}
+
+inline bool is_hw_emulation() {
+    return false;
+}
+
+} // namespace xcl
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "cmdlineparser.h"
+
+using namespace std;
+
+// Benchmark sweep : runs every host binary given with -e (e.g. the FPGA build and the emulator build)
+// on every combination of matrix layout, pages, out-degree, precision and compute units. A configuration
+// is run warmup + repetitions times, each in a fresh process; the warmup runs are dropped and the median
+// iteration time of every other run is one sample of the record appended to the results file (see
+// bench.h). The CPU reference is recorded once per configuration, from the first engine.
+
+vector<string> split_list(const string& list) {
+    vector<string> items;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+int main(int argc, char** argv) {
+    sda::utils::CmdLineParser parser;
+
+    parser.addSwitch("--engines", "-e", "host binaries to run, comma separated", "./host");
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--matrix", "-m", "matrix layouts, comma separated", "dense,csr");
+    parser.addSwitch("--nodes", "-n", "page counts, comma separated", "1024,2048");
+    parser.addSwitch("--degree", "-g", "out-links per page for csr (the density), comma separated", "10");
+    parser.addSwitch("--precision", "-q", "dense matrix storage, comma separated", "fp32");
+    parser.addSwitch("--compute_units", "-u", "compute units per card, comma separated (0 : all)", "0");
+    parser.addSwitch("--iterations", "-i", "Pagerank iterations per run", "10");
+    parser.addSwitch("--warmup", "-w", "runs of each configuration before the measured ones", "1");
+    parser.addSwitch("--repetitions", "-r", "measured runs per configuration", "5");
+    parser.addSwitch("--output", "-o", "results file (*.json : JSON lines, else CSV)", "pagerank_bench.csv");
+    parser.parse(argc, argv);
+
+    int iterations = parser.value_to_int("iterations");
+    int warmup = parser.value_to_int("warmup");
+    int reps = parser.value_to_int("repetitions");
+    string output = parser.value("output");
+    string scratch = output + ".run.csv";
+    if (parser.value("xclbin_file").empty() || iterations < 1 || warmup < 0 || reps < 1) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+
+    vector<string> engines = split_list(parser.value("engines"));
+    vector<string> degrees = split_list(parser.value("degree"));
+    int runs = 0, failed = 0, records = 0;
+    for (const string& matrix : split_list(parser.value("matrix")))
+        for (const string& nodes : split_list(parser.value("nodes")))
+            for (const string& degree : degrees)
+                for (const string& precision : split_list(parser.value("precision")))
+                    for (const string& cus : split_list(parser.value("compute_units"))) {
+                        // the packed precisions only exist for the dense matrix, the degree only for csr
+                        if (precision != "fp32" && matrix != "dense") continue;
+                        if (matrix != "csr" && degree != degrees[0]) continue;
+
+                        for (size_t e = 0; e < engines.size(); e++) {
+                            // one record per engine name of this binary, in the order they first appear
+                            vector<BenchRecord> merged;
+                            string cmd = engines[e] + " -x " + parser.value("xclbin_file") + " -m " + matrix +
+                                         " -n " + nodes + " -g " + degree + " -q " + precision + " -u " + cus +
+                                         " -i " + to_string(iterations) + " -w 0 -b " + scratch;
+                            cout << "[" << ++runs << "] " << cmd << " (" << warmup << " + " << reps << " runs)"
+                                 << endl;
+                            bool ok = true;
+                            for (int run = 0; ok && run < warmup + reps; run++) {
+                                remove(scratch.c_str());
+                                vector<BenchRecord> found;
+                                ok = system((cmd + " > /dev/null").c_str()) == 0 && bench_read(scratch, found);
+                                if (!ok || run < warmup) continue;
+
+                                for (const BenchRecord& r : found) {
+                                    if (e > 0 && r.engine.compare(0, 4, "cpu-") == 0) continue;
+                                    auto it = find_if(merged.begin(), merged.end(),
+                                                      [&](const BenchRecord& m) { return m.engine == r.engine; });
+                                    if (it == merged.end()) {
+                                        merged.push_back(r);
+                                    } else {
+                                        it->ns.push_back(r.ns[0]);
+                                    }
+                                }
+                            }
+                            if (!ok) {
+                                cout << "    failed\n";
+                                failed++;
+                            }
+                            for (const BenchRecord& r : merged) records += bench_append(output, r);
+                        }
+                    }
+    remove(scratch.c_str());
+
+    cout << records << " records of " << runs - failed << " of " << runs << " engine runs appended to " << output
+         << "\n";
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
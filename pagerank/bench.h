@@ -0,0 +1,146 @@
+/*******************************************************************************
+Description:
+   Benchmark records for the Pagerank engines, written by host (-b) and
+   collected by the bench sweep driver.
+
+   A record is one engine on one configuration : the time of every
+   measured iteration (steady_clock on the CPU, kernel timestamps on the
+   device), the first `warmup` iterations left out. It reports the median,
+   p95 and p99 of those samples, GB/s from the bytes one iteration touches
+   and edges/s from the links it multiplies (rows * columns for a dense
+   matrix, the nonzeros for csr).
+
+   bench_append() adds the record to a results file, one JSON object per
+   line when the name ends in .json, CSV with a header line otherwise, so
+   runs of different releases can be concatenated and compared.
+   bench_read() loads a CSV file back, each record with its median as the
+   only sample, which is how the sweep driver merges repeated runs.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct BenchStats {
+    int samples = 0;
+    double mean_ns = 0;
+    double median_ns = 0;
+    double p95_ns = 0;
+    double p99_ns = 0;
+};
+
+// nearest rank percentile, q in (0, 1]
+inline double bench_percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)std::ceil(q * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// samples[warmup ..], all of them when there are no more than warmup
+inline BenchStats bench_stats(const std::vector<double>& samples, int warmup) {
+    std::vector<double> s;
+    if ((int)samples.size() > warmup)
+        s.assign(samples.begin() + warmup, samples.end());
+    else
+        s = samples;
+    std::sort(s.begin(), s.end());
+
+    BenchStats stats;
+    stats.samples = s.size();
+    for (double ns : s) stats.mean_ns += ns / s.size();
+    stats.median_ns = bench_percentile(s, 0.5);
+    stats.p95_ns = bench_percentile(s, 0.95);
+    stats.p99_ns = bench_percentile(s, 0.99);
+    return stats;
+}
+
+struct BenchRecord {
+    std::string engine;     // cpu-<isa>, emu or fpga
+    std::string matrix;     // dense, wide, tiled or csr
+    std::string precision;  // storage of the dense matrix
+    int nodes = 0;
+    int64_t links = 0;      // multiply-adds per iteration
+    int compute_units = 0;  // per device, 0 on the CPU
+    int devices = 0;
+    int warmup = 0;
+    double bytes = 0;       // bytes read and written per iteration
+    std::vector<double> ns; // one sample per iteration, warmup included
+};
+
+inline bool bench_append(const std::string& path, const BenchRecord& r) {
+    BenchStats s = bench_stats(r.ns, r.warmup);
+    double gbps = s.median_ns > 0 ? r.bytes / s.median_ns : 0;
+    double edges = s.median_ns > 0 ? r.links / s.median_ns * 1e9 : 0;
+    long long stamp = std::chrono::duration_cast<std::chrono::seconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count();
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+
+    bool fresh = !std::ifstream(path).good();
+    std::ofstream out(path, std::ios::app);
+    if (!out) {
+        std::cerr << "ERROR: cannot append to " << path << std::endl;
+        return false;
+    }
+    out.precision(10);
+    if (json) {
+        out << "{\"time\":" << stamp << ",\"engine\":\"" << r.engine << "\",\"matrix\":\"" << r.matrix
+            << "\",\"precision\":\"" << r.precision << "\",\"nodes\":" << r.nodes << ",\"links\":" << r.links
+            << ",\"compute_units\":" << r.compute_units << ",\"devices\":" << r.devices
+            << ",\"warmup\":" << r.warmup << ",\"samples\":" << s.samples << ",\"mean_ns\":" << s.mean_ns
+            << ",\"median_ns\":" << s.median_ns << ",\"p95_ns\":" << s.p95_ns << ",\"p99_ns\":" << s.p99_ns
+            << ",\"gbps\":" << gbps << ",\"edges_per_s\":" << edges << ",\"bytes\":" << r.bytes << "}\n";
+    } else {
+        if (fresh) {
+            out << "time,engine,matrix,precision,nodes,links,compute_units,devices,warmup,samples,"
+                   "mean_ns,median_ns,p95_ns,p99_ns,gbps,edges_per_s,bytes\n";
+        }
+        out << stamp << "," << r.engine << "," << r.matrix << "," << r.precision << "," << r.nodes << ","
+            << r.links << "," << r.compute_units << "," << r.devices << "," << r.warmup << "," << s.samples
+            << "," << s.mean_ns << "," << s.median_ns << "," << s.p95_ns << "," << s.p99_ns << "," << gbps << ","
+            << edges << "," << r.bytes << "\n";
+    }
+    std::cout << r.engine << " " << r.matrix << " : median " << s.median_ns << " ns, p95 " << s.p95_ns
+              << " ns, p99 " << s.p99_ns << " ns, " << gbps << " GB/s, " << edges << " edges/s -> " << path
+              << "\n";
+    return true;
+}
+
+inline bool bench_read(const std::string& path, std::vector<BenchRecord>& records) {
+    std::ifstream in(path);
+    std::string line, field;
+    std::vector<std::string> header;
+    if (!in || !std::getline(in, line)) {
+        std::cerr << "ERROR: cannot read " << path << std::endl;
+        return false;
+    }
+    for (std::stringstream ss(line); std::getline(ss, field, ',');) header.push_back(field);
+
+    while (std::getline(in, line)) {
+        std::map<std::string, std::string> f;
+        std::stringstream ss(line);
+        for (size_t i = 0; i < header.size() && std::getline(ss, field, ','); i++) f[header[i]] = field;
+
+        BenchRecord r;
+        r.engine = f["engine"];
+        r.matrix = f["matrix"];
+        r.precision = f["precision"];
+        r.nodes = std::stoi(f["nodes"]);
+        r.links = std::stoll(f["links"]);
+        r.compute_units = std::stoi(f["compute_units"]);
+        r.devices = std::stoi(f["devices"]);
+        r.bytes = std::stod(f["bytes"]);
+        r.ns.push_back(std::stod(f["median_ns"]));
+        records.push_back(r);
+    }
+    return true;
+}
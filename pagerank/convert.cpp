@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "edge_loader.h"
+#include "graph_file.h"
+#include "sparse_graph.h"
+
+using namespace std;
+
+// Converts a graph into the mmap-able *.csr format read by host -f.
+//   dense : the dataN.txt files ("rows columns iters" + column-normalized matrix, V and gold are ignored)
+//   edges : SNAP text edge list or *.bin int32 pairs
+void usage(const char* name) {
+    printf("Usage: %s <dense|edges> <input> <output.csr> [parts = 3]\n", name);
+}
+
+bool read_dense(const char* path, CsrGraph& g) {
+    FILE* f = fopen(path, "r");
+    int rows, columns, iters;
+
+    if (f == NULL || fscanf(f, "%d %d %d", &rows, &columns, &iters) != 3 || rows != columns) {
+        printf("%s is not a square dense matrix file\n", path);
+        if (f) fclose(f);
+        return false;
+    }
+
+    vector<float> M((size_t)rows * columns);
+    for (size_t i = 0; i < M.size(); i++) {
+        if (fscanf(f, "%f", &M[i]) != 1) {
+            printf("%s ends after %zu of %zu values\n", path, i, M.size());
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+
+    g = csr_from_dense(M.data(), rows);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    string kind = argv[1];
+    int parts = argc > 4 ? atoi(argv[4]) : 3;
+    CsrGraph g;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (kind == "dense") {
+        if (!read_dense(argv[2], g)) return EXIT_FAILURE;
+    } else if (kind == "edges") {
+        if (!csr_from_edge_file(argv[2], edge_format_of(argv[2]), g)) return EXIT_FAILURE;
+    } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (parts < 1 || parts > g.nodes) {
+        printf("%d parts do not fit %d pages\n", parts, g.nodes);
+        return EXIT_FAILURE;
+    }
+    // one part per compute unit, balanced by nonzeros like host does for graphs it builds itself
+    vector<int> row_begin = balanced_row_begin(g.row_ptr.data(), g.nodes, parts);
+
+    if (!write_graph_file(argv[3], partition_csr(g, row_begin))) return EXIT_FAILURE;
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << argv[3] << " : " << g.nodes << " pages, " << g.nnz() << " links, " << parts << " parts\n";
+    cout << "Conversion time : " << elapsed.count() << " s\n";
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*******************************************************************************
+Description:
+   CPU Pagerank engine shared by host (gold vector, CPU fallback) and verify.
+   Dense and CSR steps are parallel over rows (OpenMP). The dense rows and
+   the CSR teleport sum are vectorized with AVX2 or AVX-512, picked at run
+   time with __builtin_cpu_supports. PAGERANK_ISA=scalar|avx2|avx512 in the
+   environment caps the choice.
+
+   Every row is still summed one column (or edge) at a time in order, with
+   a separate multiply and add, exactly like the kernels. The SIMD lanes
+   work on different rows instead of splitting one row, so the result is
+   bit for bit the same on every ISA and thread count and the device output
+   can be compared for equality. Nothing here is contracted into FMA, the
+   scalar paths included.
+
+   The CSR rows stay scalar : one row per lane needs three gathers per edge
+   (col_idx, val, the rank) and the lanes of a power-law graph sit idle
+   behind its longest row, measured 1.3 to 4 times slower than the scalar
+   loop with AVX2 and AVX-512 alike.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "sparse_graph.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <string>
+#include <vector>
+
+enum class CpuIsa { scalar, avx2, avx512 };
+
+inline const char* cpu_isa_name(CpuIsa isa) {
+    return isa == CpuIsa::avx512 ? "avx512" : isa == CpuIsa::avx2 ? "avx2" : "scalar";
+}
+
+inline CpuIsa cpu_isa() {
+    static CpuIsa isa = [] {
+        CpuIsa best = __builtin_cpu_supports("avx512f") ? CpuIsa::avx512
+                      : __builtin_cpu_supports("avx2")  ? CpuIsa::avx2
+                                                        : CpuIsa::scalar;
+        const char* cap = getenv("PAGERANK_ISA");
+        if (cap && std::string(cap) == "scalar") best = CpuIsa::scalar;
+        if (cap && std::string(cap) == "avx2" && best == CpuIsa::avx512) best = CpuIsa::avx2;
+        return best;
+    }();
+    return isa;
+}
+
+// The multiplies and adds must stay separate instructions to match the kernels.
+#define CPU_ENGINE_SCALAR PAGERANK_NO_CONTRACT
+#define CPU_ENGINE_AVX2 __attribute__((target("avx2"), optimize("fp-contract=off")))
+#define CPU_ENGINE_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+
+// out[r] for rows [first, last) of a[rows][cols]
+CPU_ENGINE_SCALAR inline void dense_rows_scalar(const float* a, const float* in, float* out, int cols, int first,
+                                                int last) {
+    for (int r = first; r < last; r++) {
+        float sum = 0;
+        for (int c = 0; c < cols; c++) sum += a[(size_t)r * cols + c] * in[c];
+        out[r] = sum;
+    }
+}
+
+// 8 rows at a time : an 8x8 block is transposed so each vector holds one column of the 8 rows.
+CPU_ENGINE_AVX2 inline void dense_rows_avx2(const float* a, const float* in, float* out, int cols, int first,
+                                            int last) {
+    int r = first;
+    for (; r + 8 <= last; r += 8) {
+        const float* row = a + (size_t)r * cols;
+        __m256 acc = _mm256_setzero_ps();
+        int c = 0;
+        for (; c + 8 <= cols; c += 8) {
+            __m256 x[8], t[8], u[8];
+            for (int l = 0; l < 8; l++) x[l] = _mm256_loadu_ps(row + (size_t)l * cols + c);
+            for (int l = 0; l < 8; l += 2) {
+                t[l] = _mm256_unpacklo_ps(x[l], x[l + 1]);
+                t[l + 1] = _mm256_unpackhi_ps(x[l], x[l + 1]);
+            }
+            for (int l = 0; l < 8; l += 4) {
+                u[l] = _mm256_shuffle_ps(t[l], t[l + 2], 0x44);
+                u[l + 1] = _mm256_shuffle_ps(t[l], t[l + 2], 0xee);
+                u[l + 2] = _mm256_shuffle_ps(t[l + 1], t[l + 3], 0x44);
+                u[l + 3] = _mm256_shuffle_ps(t[l + 1], t[l + 3], 0xee);
+            }
+            for (int k = 0; k < 4; k++) {
+                x[k] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x20);
+                x[k + 4] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x31);
+            }
+            for (int k = 0; k < 8; k++) acc = _mm256_add_ps(acc, _mm256_mul_ps(x[k], _mm256_set1_ps(in[c + k])));
+        }
+
+        float sum[8];
+        _mm256_storeu_ps(sum, acc);
+        for (int l = 0; l < 8; l++) {
+            for (int k = c; k < cols; k++) sum[l] += row[(size_t)l * cols + k] * in[k];
+            out[r + l] = sum[l];
+        }
+    }
+    dense_rows_scalar(a, in, out, cols, r, last);
+}
+
+// 16 rows at a time, one gather per column.
+CPU_ENGINE_AVX512 inline void dense_rows_avx512(const float* a, const float* in, float* out, int cols, int first,
+                                                int last) {
+    int r = first;
+    if ((int64_t)cols * 15 <= INT32_MAX) {
+        __m512i offset = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                                            _mm512_set1_epi32(cols));
+        for (; r + 16 <= last; r += 16) {
+            const float* row = a + (size_t)r * cols;
+            __m512 acc = _mm512_setzero_ps();
+            for (int c = 0; c < cols; c++) {
+                __m512 x = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xffff, offset, row + c, 4);
+                acc = _mm512_add_ps(acc, _mm512_mul_ps(x, _mm512_set1_ps(in[c])));
+            }
+            _mm512_storeu_ps(out + r, acc);
+        }
+    }
+    dense_rows_avx2(a, in, out, cols, r, last);
+}
+
+// out = a * in for a[rows][cols], rows split over the OpenMP threads
+inline void dense_matvec(const float* a, const float* in, float* out, int rows, int cols) {
+    const int block = 64;
+    CpuIsa isa = cpu_isa();
+
+#pragma omp parallel for schedule(static)
+    for (int first = 0; first < rows; first += block) {
+        int last = first + block < rows ? first + block : rows;
+        if (isa == CpuIsa::avx512)
+            dense_rows_avx512(a, in, out, cols, first, last);
+        else if (isa == CpuIsa::avx2)
+            dense_rows_avx2(a, in, out, cols, first, last);
+        else
+            dense_rows_scalar(a, in, out, cols, first, last);
+    }
+}
+
+// The 8 teleport lanes are exactly one AVX register. The 8 dangling bits of a group pick the
+// lanes that also go into the mass, the others add +0 like the kernel.
+CPU_ENGINE_AVX2 inline float teleport_avx2(const float* v, const uint32_t* dangling, int nodes, float d) {
+    static_assert(teleport_lanes == 8, "teleport_avx2 keeps one lane per teleport_lanes");
+    const __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256 acc = _mm256_setzero_ps();
+    __m256 mass_acc = _mm256_setzero_ps();
+    float lane[teleport_lanes], mass_lane[teleport_lanes];
+    float total = 0, mass = 0;
+    int i = 0;
+
+    for (; i + 8 <= nodes; i += 8) {
+        __m256 x = _mm256_loadu_ps(v + i);
+        __m256i flags = _mm256_set1_epi32((dangling[i / 32] >> (i % 32)) & 0xff);
+        __m256i on = _mm256_cmpeq_epi32(_mm256_and_si256(flags, bit), bit);
+        acc = _mm256_add_ps(acc, x);
+        mass_acc = _mm256_add_ps(mass_acc, _mm256_and_ps(x, _mm256_castsi256_ps(on)));
+    }
+    _mm256_storeu_ps(lane, acc);
+    _mm256_storeu_ps(mass_lane, mass_acc);
+    for (; i < nodes; i++) {
+        lane[i % teleport_lanes] += v[i];
+        mass_lane[i % teleport_lanes] += (dangling[i / 32] >> (i % 32)) & 1 ? v[i] : 0.0f;
+    }
+    for (int l = 0; l < teleport_lanes; l++) {
+        total += lane[l];
+        mass += mass_lane[l];
+    }
+    return (1 - d) / nodes * total + d / nodes * mass;
+}
+
+// Rows [first, last) of one chunk, same as csr_rows. Rows are handed out in small
+// dynamic blocks since power-law rows differ wildly in length.
+CPU_ENGINE_SCALAR inline void csr_part_rows(const CsrPart& p, int first, int last, const float* in, float* out,
+                                            float d, float tele) {
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int r = first; r < last; r++) {
+        float sum = 0;
+        for (int e = p.row_ptr[r]; e < p.row_ptr[r + 1]; e++) sum += p.val[e] * in[p.col_idx[e]];
+        out[p.row_begin + r] = d * sum + tele;
+    }
+}
+
+// v <- one Pagerank step of v, same result as csr_matmul.
+inline void csr_step(const CsrPartition& g, float* v, float d, std::vector<float>& temp) {
+    float tele = cpu_isa() == CpuIsa::scalar ? teleport(v, g.dangling.data(), g.nodes, d)
+                                              : teleport_avx2(v, g.dangling.data(), g.nodes, d);
+
+    temp.resize(g.nodes);
+    for (const CsrPart& p : g.parts) csr_part_rows(p, 0, p.rows, v, temp.data(), d, tele);
+    memcpy(v, temp.data(), g.nodes * sizeof(float));
+}
+
+// v <- a * v for a square a[n][n]
+inline void dense_step(const float* a, float* v, int n, std::vector<float>& temp) {
+    temp.resize(n);
+    dense_matvec(a, v, temp.data(), n, n);
+    memcpy(v, temp.data(), n * sizeof(float));
+}
@@ -1,7 +1,13 @@
 /*******************************************************************************
 Description:
    Pagerank algorithm : using multiple compute units (just 1 iteration)
-   RES_SIZE = size of pages / number of compute units
+   res_size = rows of this compute unit, any split of the pages works so the
+   host can use however many instances the xclbin was linked with
+   out_r is the whole rank vector, this compute unit writes
+   out_r[row_begin .. row_begin + res_size) so in2 and out_r can ping-pong
+   between two device buffers without going through the host.
+   residual[0] = sum |out_r[row] - in2[row]| over the rows of this compute
+   unit, the host adds the partial sums up to decide convergence
 
 *******************************************************************************/
 
@@ -10,17 +16,16 @@ Description:
 #include <string.h>
 
 #define MAX_SIZE 2400
-#define RES_SIZE 800
 
 // TRIPCOUNT identifiers
 const unsigned int c_dim = MAX_SIZE;
-const unsigned int d_dim = RES_SIZE;
+const unsigned int d_dim = MAX_SIZE / 3;
 
 extern "C" {
-void cu3_pagerank(float* in1, float* in2, float* out_r, int size, int res_size) {
-    // Local buffers to hold temporary data
-    float temp_sum[RES_SIZE];
+void cu3_pagerank(float* in1, float* in2, float* out_r, int size, int res_size, int row_begin, float* residual) {
+    // Local buffer to hold temporary data
     float B[MAX_SIZE];
+    float diff = 0;
 
 // Read data from global memory and write into local buffer for in2
 readB:
@@ -30,30 +35,22 @@ readB:
         B[itr] = in2[itr];
     }
 
+// Each row is written as soon as it is done, so no buffer sized by the row count is needed
 nopart1:
 	for (int row = 0; row < res_size; row++) {
 #pragma HLS LOOP_TRIPCOUNT min = d_dim max = d_dim
+        float temp_sum = 0;
     nopart2:
-    	temp_sum[row] = 0;
         for (int col = 0; col < size; col++) {
 #pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
 #pragma HLS PIPELINE II=1
-        nopart3:
-        	temp_sum[row] += in1[row * size + col] * B[col];
+        	temp_sum += in1[(size_t)row * size + col] * B[col];
         }
-    }
-
-//	for(int row = 0; row < res_size; row++) {
-//#pragma HLS LOOP_TRIPCOUNT min = d_dim max = d_dim
-//		in2[row] = temp_sum[row];
-//    }
 
-// Write results from local buffer to global memory for out
-writeC:
-    for (int itr = 0; itr < res_size; itr++) {
-#pragma HLS LOOP_TRIPCOUNT min = d_dim max = d_dim
-#pragma HLS PIPELINE II=1
-        out_r[itr] = temp_sum[itr];
+        float delta = temp_sum - B[row_begin + row];
+        out_r[row_begin + row] = temp_sum;
+        diff += delta < 0 ? -delta : delta;
     }
+    residual[0] = diff;
 }
 }
@@ -0,0 +1,90 @@
+/*******************************************************************************
+Description:
+   Pagerank algorithm on a CSR link matrix : using multiple compute units (just 1 iteration)
+   Each compute unit gets its own chunk of the CSR arrays (row_ptr rebased
+   to 0) covering pages [row_begin, row_begin + res_size) :
+       out_r[row_begin + row] = d * sum(val[e] * in2[col_idx[e]]) + teleport
+   teleport = (1 - d) / N * sum(in2) + d / N * sum(in2[dangling pages]) is a
+   scalar, so the dense damping fill of cu3_pagerank is never needed. The
+   second sum is the rank of the pages without out-links, spread over every
+   page instead of being lost. dangling has bit p % 32 of word p / 32 set for
+   such a page. Every compute unit sums both in the same sequential pass over
+   in2 with SUM_LANES interleaved accumulators each, so an iteration never
+   waits on the host for them.
+   out_r is the whole rank vector so in2 and out_r can ping-pong on the device.
+   residual[0] = sum |out_r[row] - in2[row]| over this chunk (L1 residual)
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define SUM_LANES 8
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = 2400;
+const unsigned int r_dim = 800;
+const unsigned int e_dim = 10;
+
+extern "C" {
+void cu3_pagerank_csr(int* row_ptr, int* col_idx, float* val, float* in2, float* out_r, int row_begin,
+                      int res_size, float d, int nodes, float* residual, unsigned int* dangling) {
+    float lane[SUM_LANES];
+    float mass_lane[SUM_LANES];
+#pragma HLS ARRAY_PARTITION variable = lane complete
+#pragma HLS ARRAY_PARTITION variable = mass_lane complete
+    float diff = 0;
+    float total = 0;
+    float mass = 0;
+    unsigned int flags = 0;
+
+initSum:
+    for (int l = 0; l < SUM_LANES; l++) {
+#pragma HLS UNROLL
+        lane[l] = 0;
+        mass_lane[l] = 0;
+    }
+
+// Lane l only depends on itself SUM_LANES iterations back, which covers the adder latency
+sumIn:
+    for (int itr = 0; itr < nodes; itr++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+#pragma HLS DEPENDENCE variable = lane inter distance = SUM_LANES true
+#pragma HLS DEPENDENCE variable = mass_lane inter distance = SUM_LANES true
+        if (itr % 32 == 0) flags = dangling[itr / 32];
+        float v = in2[itr];
+        lane[itr % SUM_LANES] += v;
+        mass_lane[itr % SUM_LANES] += (flags >> (itr % 32)) & 1 ? v : 0.0f;
+    }
+
+reduceSum:
+    for (int l = 0; l < SUM_LANES; l++) {
+        total += lane[l];
+        mass += mass_lane[l];
+    }
+    float teleport = (1 - d) / nodes * total + d / nodes * mass;
+
+rows:
+    for (int row = 0; row < res_size; row++) {
+#pragma HLS LOOP_TRIPCOUNT min = r_dim max = r_dim
+        int begin = row_ptr[row];
+        int end = row_ptr[row + 1];
+        float sum = 0;
+
+    edges:
+        for (int e = begin; e < end; e++) {
+#pragma HLS LOOP_TRIPCOUNT min = e_dim max = e_dim
+#pragma HLS PIPELINE II=1
+            sum += val[e] * in2[col_idx[e]];
+        }
+
+        float rank = d * sum + teleport;
+        float delta = rank - in2[row_begin + row];
+        out_r[row_begin + row] = rank;
+        diff += delta < 0 ? -delta : delta;
+    }
+    residual[0] = diff;
+}
+}
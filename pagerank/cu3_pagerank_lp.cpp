@@ -0,0 +1,91 @@
+/*******************************************************************************
+Description:
+   Pagerank algorithm : cu3_pagerank with a reduced precision link matrix (just 1 iteration)
+   in1 holds the rows of this compute unit packed into 32-bit words, every row
+   starting on a new word :
+       format 0 bf16, 1 fp16, 2 q16 (q * scale) : 2 elements per word
+       format 3 q8 (q * scale)                  : 4 elements per word
+   low bits first. Every element is widened to fp32 before the multiply, the
+   sums stay fp32 and in column order like cu3_pagerank, so only the stored
+   matrix loses precision while it takes 1/2 or 1/4 of the bytes.
+   out_r is the whole rank vector, this compute unit writes
+   out_r[row_begin .. row_begin + res_size)
+   residual[0] = sum |out_r[row] - in2[row]| over the rows of this compute unit
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SIZE 2400
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = MAX_SIZE;
+const unsigned int d_dim = MAX_SIZE / 3;
+
+static float widen(unsigned int bits, int format, float scale) {
+#pragma HLS INLINE
+    unsigned int u;
+    float f;
+
+    if (format == 0) {
+        u = bits << 16;
+    } else if (format == 1) {
+        unsigned int e = (bits >> 10) & 0x1f;
+        unsigned int m = bits & 0x3ff;
+        if (e == 0) {
+            // subnormal half
+            f = m * 5.9604644775390625e-08f;
+            return (bits & 0x8000) ? -f : f;
+        }
+        u = ((bits & 0x8000) << 16) | ((e + 127 - 15) << 23) | (m << 13);
+    } else {
+        return bits * scale;
+    }
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+extern "C" {
+void cu3_pagerank_lp(unsigned int* in1, float* in2, float* out_r, int size, int res_size, int row_begin,
+                     float* residual, int format, float scale) {
+    // Local buffer to hold temporary data
+    float B[MAX_SIZE];
+    int per_word = format == 3 ? 4 : 2;
+    int bits = 32 / per_word;
+    unsigned int mask = format == 3 ? 0xff : 0xffff;
+    int words = (size + per_word - 1) / per_word;
+    float diff = 0;
+
+// Read data from global memory and write into local buffer for in2
+readB:
+    for (int itr = 0; itr < size; itr++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+        B[itr] = in2[itr];
+    }
+
+nopart1:
+    for (int row = 0; row < res_size; row++) {
+#pragma HLS LOOP_TRIPCOUNT min = d_dim max = d_dim
+        float temp_sum = 0;
+        unsigned int word = 0;
+    nopart2:
+        for (int col = 0; col < size; col++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+            int slot = col % per_word;
+            if (slot == 0) {
+                word = in1[(size_t)row * words + col / per_word];
+            }
+            temp_sum += widen((word >> (bits * slot)) & mask, format, scale) * B[col];
+        }
+
+        float delta = temp_sum - B[row_begin + row];
+        out_r[row_begin + row] = temp_sum;
+        diff += delta < 0 ? -delta : delta;
+    }
+    residual[0] = diff;
+}
+}
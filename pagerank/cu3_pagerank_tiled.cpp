@@ -0,0 +1,82 @@
+/*******************************************************************************
+Description:
+   Pagerank algorithm : column tiled version of cu3_pagerank (just 1 iteration)
+   cu3_pagerank keeps the whole input vector in B[MAX_SIZE], which caps the
+   graph at what fits in BRAM. Here one call covers a row tile of at most
+   ROW_TILE rows, and the input vector is streamed through B in COL_TILE
+   blocks together with the matching block of every row :
+       temp_sum[row] += in1[row * size + col] * in2[col]   col in [c, c + COL_TILE)
+   so size is only limited by device memory. The host tile scheduler
+   splits the pages into row tiles and spreads them over the compute units.
+   out_r is the whole rank vector, this call writes
+   out_r[row_begin .. row_begin + res_size)
+   residual[0] = sum |out_r[row] - in2[row]| over the rows of this tile
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define ROW_TILE 256
+#define COL_TILE 2048
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = COL_TILE;
+const unsigned int r_dim = ROW_TILE;
+const unsigned int t_dim = 8;
+
+extern "C" {
+void cu3_pagerank_tiled(float* in1, float* in2, float* out_r, int size, int res_size, int row_begin,
+                        float* residual) {
+    // Local buffers to hold temporary data
+    float temp_sum[ROW_TILE];
+    float B[COL_TILE];
+    float diff = 0;
+
+initSum:
+    for (int row = 0; row < res_size; row++) {
+#pragma HLS LOOP_TRIPCOUNT min = r_dim max = r_dim
+#pragma HLS PIPELINE II=1
+        temp_sum[row] = 0;
+    }
+
+colTiles:
+    for (int c = 0; c < size; c += COL_TILE) {
+#pragma HLS LOOP_TRIPCOUNT min = t_dim max = t_dim
+        int cols = size - c < COL_TILE ? size - c : COL_TILE;
+
+    // Read the next block of in2 into the local buffer
+    readB:
+        for (int itr = 0; itr < cols; itr++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+            B[itr] = in2[c + itr];
+        }
+
+    rowTile:
+        for (int row = 0; row < res_size; row++) {
+#pragma HLS LOOP_TRIPCOUNT min = r_dim max = r_dim
+            float sum = temp_sum[row];
+        colTile:
+            for (int col = 0; col < cols; col++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+                sum += in1[(size_t)row * size + c + col] * B[col];
+            }
+            temp_sum[row] = sum;
+        }
+    }
+
+// Write results from local buffer to global memory for out
+writeC:
+    for (int itr = 0; itr < res_size; itr++) {
+#pragma HLS LOOP_TRIPCOUNT min = r_dim max = r_dim
+#pragma HLS PIPELINE II=1
+        float delta = temp_sum[itr] - in2[row_begin + itr];
+        out_r[row_begin + itr] = temp_sum[itr];
+        diff += delta < 0 ? -delta : delta;
+    }
+    residual[0] = diff;
+}
+}
@@ -0,0 +1,109 @@
+/*******************************************************************************
+Description:
+   Pagerank algorithm : 512-bit version of cu3_pagerank (just 1 iteration)
+   In cu3_pagerank every column waits for the previous floating point add of
+   temp_sum[row], so the II=1 pipeline really runs at the adder latency.
+   Here in1 is read one 512-bit beat (LANES floats) per cycle :
+     - the LANES products of a beat are summed by an adder tree (no loop
+       carried dependency)
+     - beat k is added to partial sum acc[k % ACC], so the same accumulator
+       is only touched again ACC cycles later, which covers the adder latency
+     - the ACC partial sums are added by a second tree at the end of the row
+   Rows of in1 are padded with zeros to a multiple of LANES columns, the host
+   repeats the same summation order for the gold result.
+   out_r is the whole rank vector, this compute unit writes
+   out_r[row_begin .. row_begin + res_size)
+   residual[0] = sum |out_r[row] - in2[row]| over the rows of this compute unit
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SIZE 2400
+#define LANES 16
+#define ACC 8
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = MAX_SIZE;
+const unsigned int b_dim = MAX_SIZE / LANES;
+const unsigned int d_dim = MAX_SIZE / 3;
+
+// One 512-bit word of in1
+typedef struct v_datatype {
+    float data[LANES];
+} v_dt;
+
+extern "C" {
+void cu3_pagerank_wide(v_dt* in1, float* in2, float* out_r, int size, int res_size, int row_begin, float* residual) {
+#pragma HLS INTERFACE m_axi port = in1 offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = in2 offset = slave bundle = gmem1
+#pragma HLS INTERFACE m_axi port = out_r offset = slave bundle = gmem1
+#pragma HLS INTERFACE m_axi port = residual offset = slave bundle = gmem1
+    // Local buffer to hold temporary data, LANES reads per cycle
+    float B[MAX_SIZE];
+#pragma HLS ARRAY_PARTITION variable = B cyclic factor = LANES
+    int beats = (size + LANES - 1) / LANES;
+    float diff = 0;
+
+// Read data from global memory and write into local buffer for in2, zero the padding
+readB:
+    for (int itr = 0; itr < beats * LANES; itr++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+        B[itr] = itr < size ? in2[itr] : 0;
+    }
+
+rows:
+    for (int row = 0; row < res_size; row++) {
+#pragma HLS LOOP_TRIPCOUNT min = d_dim max = d_dim
+        float acc[ACC];
+#pragma HLS ARRAY_PARTITION variable = acc complete
+    initAcc:
+        for (int a = 0; a < ACC; a++) {
+#pragma HLS UNROLL
+            acc[a] = 0;
+        }
+
+    // acc[k % ACC] is only read back ACC beats later
+    beatLoop:
+        for (int k = 0; k < beats; k++) {
+#pragma HLS LOOP_TRIPCOUNT min = b_dim max = b_dim
+#pragma HLS PIPELINE II=1
+#pragma HLS DEPENDENCE variable = acc inter distance = ACC true
+            v_dt a = in1[(size_t)row * beats + k];
+            float p[LANES];
+#pragma HLS ARRAY_PARTITION variable = p complete
+        products:
+            for (int l = 0; l < LANES; l++) {
+#pragma HLS UNROLL
+                p[l] = a.data[l] * B[k * LANES + l];
+            }
+        treeBeat:
+            for (int w = LANES / 2; w > 0; w /= 2) {
+#pragma HLS UNROLL
+                for (int l = 0; l < w; l++) {
+#pragma HLS UNROLL
+                    p[l] = p[l] + p[l + w];
+                }
+            }
+            acc[k % ACC] += p[0];
+        }
+
+    treeAcc:
+        for (int w = ACC / 2; w > 0; w /= 2) {
+#pragma HLS UNROLL
+            for (int l = 0; l < w; l++) {
+#pragma HLS UNROLL
+                acc[l] = acc[l] + acc[l + w];
+            }
+        }
+
+        float delta = acc[0] - B[row_begin + row];
+        out_r[row_begin + row] = acc[0];
+        diff += delta < 0 ? -delta : delta;
+    }
+    residual[0] = diff;
+}
+}
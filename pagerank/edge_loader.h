@@ -0,0 +1,195 @@
+/*******************************************************************************
+Description:
+   Streaming edge-list loader for the CSR Pagerank engine.
+   Reads SNAP style text ("src dst" per line, '#' or '%' comments) or raw
+   binary edges (little-endian int32 src, dst pairs, *.bin) in fixed-size
+   chunks and builds the CsrGraph in two passes over the file:
+     pass 1 : out-degree per page and in-degree per row (row_ptr)
+     pass 2 : scatter every edge into its row
+   Neither the raw text nor the edge list is ever held in memory, so peak
+   usage is the CSR arrays plus one chunk. Page ids are used as-is, the
+   graph has max(id) + 1 pages.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "sparse_graph.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+enum class EdgeFormat { text, binary };
+
+const size_t edge_chunk_bytes = 4 << 20;
+
+inline EdgeFormat edge_format_of(const std::string& path) {
+    auto pos = path.rfind('.');
+    return (pos != std::string::npos && path.substr(pos) == ".bin") ? EdgeFormat::binary : EdgeFormat::text;
+}
+
+// Parses the complete lines of [p, end). Returns where the unparsed tail starts. Lines that are not
+// blank or a comment but do not start with two ids in [0, INT_MAX) are counted in skipped.
+inline const char* parse_edge_lines(const char* p, const char* end, bool last, std::vector<Edge>& out,
+                                    size_t& skipped) {
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) {
+            if (!last) return p;
+            eol = end;
+        }
+
+        long ids[2];
+        int found = 0;
+        bool blank = true;
+        const char* c = p;
+        while (found < 2 && c < eol) {
+            while (c < eol && (*c == ' ' || *c == '\t' || *c == ',' || *c == '\r')) c++;
+            if (c == eol || (blank && (*c == '#' || *c == '%'))) break;
+            blank = false;
+            if (*c < '0' || *c > '9') break;
+            // INT_MAX itself would overflow the page count max(id) + 1
+            long v = 0;
+            while (c < eol && *c >= '0' && *c <= '9' && v < INT_MAX) v = v * 10 + (*c++ - '0');
+            if (v >= INT_MAX) break;
+            ids[found++] = v;
+        }
+        if (found == 2)
+            out.push_back({(int)ids[0], (int)ids[1]});
+        else if (!blank)
+            skipped++;
+
+        p = eol + 1;
+    }
+    return end;
+}
+
+// Calls fn(const Edge* edges, size_t count) once per chunk of the file, warn reports the bytes and
+// lines that were ignored.
+template <typename Fn>
+bool for_each_edge_chunk(const std::string& path, EdgeFormat format, Fn fn, bool warn = true) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "ERROR: open " << path << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<char> buf(edge_chunk_bytes);
+    std::vector<Edge> edges;
+    size_t carry = 0, skipped = 0;
+
+    edges.reserve(edge_chunk_bytes / sizeof(Edge));
+    for (;;) {
+        ssize_t got = read(fd, buf.data() + carry, edge_chunk_bytes - carry);
+        if (got < 0) {
+            std::cerr << "ERROR: read " << path << " failed: " << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+        bool last = got == 0;
+        size_t len = carry + got;
+        size_t used;
+
+        if (format == EdgeFormat::binary) {
+            used = len / sizeof(Edge) * sizeof(Edge);
+            edges.resize(used / sizeof(Edge));
+            memcpy(edges.data(), buf.data(), used);
+        } else {
+            used = parse_edge_lines(buf.data(), buf.data() + len, last, edges, skipped) - buf.data();
+        }
+
+        if (!edges.empty()) fn(edges.data(), edges.size());
+        edges.clear();
+
+        carry = len - used;
+        memmove(buf.data(), buf.data() + used, carry);
+        if (last) break;
+        if (carry == edge_chunk_bytes) {
+            std::cerr << "ERROR: " << path << " has a line longer than " << edge_chunk_bytes << " bytes" << std::endl;
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+
+    if (warn && carry) std::cout << "WARNING: ignoring " << carry << " trailing bytes of " << path << "\n";
+    if (warn && skipped) {
+        std::cout << "WARNING: ignoring " << skipped << " lines of " << path << " without two page ids in [0, "
+                  << INT_MAX << ")\n";
+    }
+    return true;
+}
+
+// Builds g in two passes over the edges, each_chunk(fn) must call fn(const Edge* edges, size_t count)
+// for every chunk in the same order both times and return false on failure. The graph has at least
+// min_nodes pages, more if an id is larger. Ids must be in [0, INT_MAX) and there may be at most
+// INT_MAX edges, the int32 bounds of the CSR arrays. what names the source in errors.
+template <typename EachChunk>
+bool csr_from_edge_chunks(EachChunk each_chunk, int min_nodes, const std::string& what, CsrGraph& g) {
+    std::vector<int> out_degree(min_nodes, 0);
+    int64_t edge_count = 0;
+    bool ok = true;
+
+    g = CsrGraph();
+    g.nodes = min_nodes;
+    g.row_ptr.assign(min_nodes + 1, 0);
+
+    // pass 1 : degrees, row_ptr[dst + 1] counts the in-links of dst
+    ok = each_chunk([&](const Edge* edges, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            int top = std::max(edges[i].src, edges[i].dst);
+            // INT_MAX itself would overflow the page count top + 1, like in parse_edge_lines
+            if (edges[i].src < 0 || edges[i].dst < 0 || top == INT_MAX || ++edge_count > INT_MAX) {
+                ok = false;
+                continue;
+            }
+            if (top >= g.nodes) {
+                g.nodes = top + 1;
+                out_degree.resize(g.nodes, 0);
+                g.row_ptr.resize(g.nodes + 1, 0);
+            }
+            out_degree[edges[i].src]++;
+            g.row_ptr[edges[i].dst + 1]++;
+        }
+    }) && ok;
+    if (edge_count > INT_MAX) {
+        std::cerr << "ERROR: " << what << " has more than " << INT_MAX
+                  << " links, they do not fit the int32 row pointers of the CSR format" << std::endl;
+        return false;
+    }
+    if (!ok) {
+        std::cerr << "ERROR: " << what << " is not a valid edge list" << std::endl;
+        return false;
+    }
+
+    for (int r = 0; r < g.nodes; r++) g.row_ptr[r + 1] += g.row_ptr[r];
+    g.col_idx.resize(g.row_ptr[g.nodes]);
+    g.val.resize(g.row_ptr[g.nodes]);
+
+    // pass 2 : scatter
+    std::vector<int> cursor(g.row_ptr.begin(), g.row_ptr.end() - 1);
+    return each_chunk([&](const Edge* edges, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            int pos = cursor[edges[i].dst]++;
+            g.col_idx[pos] = edges[i].src;
+            g.val[pos] = 1.0f / out_degree[edges[i].src];
+        }
+    });
+}
+
+inline bool csr_from_edge_file(const std::string& path, EdgeFormat format, CsrGraph& g) {
+    // the warnings once, on the first of the two passes
+    int pass = 0;
+    auto each_chunk = [&](const std::function<void(const Edge*, size_t)>& fn) {
+        return for_each_edge_chunk(path, format, fn, pass++ == 0);
+    };
+    return csr_from_edge_chunks(each_chunk, 0, path, g);
+}
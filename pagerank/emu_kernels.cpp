@@ -0,0 +1,34 @@
+/*******************************************************************************
+Description:
+   Kernel registrations for the software-emulated device (common/emu/xcl2.hpp).
+   Linked into the host only for emulation builds, next to the cu3_pagerank*
+   kernel sources. Every kernel is registered with the 3 compute units the
+   xclbin is linked with.
+
+*******************************************************************************/
+
+#include "xcl2.hpp"
+
+#define NUM_CU 3
+
+// One 512-bit word of cu3_pagerank_wide's in1
+typedef struct v_datatype {
+    float data[16];
+} v_dt;
+
+extern "C" {
+void cu3_pagerank(float* in1, float* in2, float* out_r, int size, int res_size, int row_begin, float* residual);
+void cu3_pagerank_csr(int* row_ptr, int* col_idx, float* val, float* in2, float* out_r, int row_begin, int res_size,
+                      float d, int nodes, float* residual, unsigned int* dangling);
+void cu3_pagerank_tiled(float* in1, float* in2, float* out_r, int size, int res_size, int row_begin,
+                        float* residual);
+void cu3_pagerank_wide(v_dt* in1, float* in2, float* out_r, int size, int res_size, int row_begin, float* residual);
+void cu3_pagerank_lp(unsigned int* in1, float* in2, float* out_r, int size, int res_size, int row_begin,
+                     float* residual, int format, float scale);
+}
+
+static bool registered = emu::register_kernel("cu3_pagerank", &cu3_pagerank, NUM_CU) &&
+                         emu::register_kernel("cu3_pagerank_csr", &cu3_pagerank_csr, NUM_CU) &&
+                         emu::register_kernel("cu3_pagerank_tiled", &cu3_pagerank_tiled, NUM_CU) &&
+                         emu::register_kernel("cu3_pagerank_wide", &cu3_pagerank_wide, NUM_CU) &&
+                         emu::register_kernel("cu3_pagerank_lp", &cu3_pagerank_lp, NUM_CU);
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cmdlineparser.h"
+#include "cpu_engine.h"
+#include "edge_loader.h"
+#include "graph_file.h"
+#include "graph_gen.h"
+#include "sparse_graph.h"
+
+using namespace std;
+
+// Writes a synthetic power-law graph (see graph_gen.h) in one of the formats host -f reads :
+//   *.csr : partitioned graph file, ready for host -f and -s
+//   *.bin : little-endian int32 src, dst pairs
+//   else  : text edge list, "src dst" per line
+// With -i N the Pagerank vector after N iterations from the uniform vector 1 / nodes is written to
+// <output>.gold as raw float32, computed like the device does.
+
+const float d = 0.85;
+
+bool write_edges(const GraphModel& model, const string& path) {
+    bool binary = edge_format_of(path) == EdgeFormat::binary;
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "ERROR: cannot write " << path << endl;
+        return false;
+    }
+    string text;
+    for_each_generated_chunk(model, [&](const Edge* edges, size_t count) {
+        if (binary) {
+            out.write(reinterpret_cast<const char*>(edges), count * sizeof(Edge));
+            return;
+        }
+        text.clear();
+        for (size_t i = 0; i < count; i++) {
+            text += to_string(edges[i].src);
+            text += ' ';
+            text += to_string(edges[i].dst);
+            text += '\n';
+        }
+        out << text;
+    });
+    return (bool)out;
+}
+
+bool write_gold(const CsrPartition& parts, int iterations, const string& path) {
+    vector<float> v(parts.nodes, 1.0f / parts.nodes), scratch;
+    for (int i = 0; i < iterations; i++) csr_step(parts, v.data(), d, scratch);
+
+    ofstream out(path, ios::binary);
+    out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(float));
+    if (!out) cerr << "ERROR: cannot write " << path << endl;
+    return (bool)out;
+}
+
+int main(int argc, char** argv) {
+    sda::utils::CmdLineParser parser;
+
+    parser.addSwitch("--model", "-m", "rmat or ba", "rmat");
+    parser.addSwitch("--nodes", "-n", "number of pages", "1048576");
+    parser.addSwitch("--degree", "-g", "average out-links per page (exact for ba)", "16");
+    parser.addSwitch("--rmat", "-a", "R-MAT quadrant probabilities a,b,c (d is the rest)", "0.57,0.19,0.19");
+    parser.addSwitch("--seed", "-s", "random seed, the same seed always gives the same graph", "1");
+    parser.addSwitch("--output", "-o", "output file : *.csr, *.bin or text edge list", "");
+    parser.addSwitch("--parts", "-p", "*.csr parts, one per compute unit", "3");
+    parser.addSwitch("--gold", "-i", "also write <output>.gold after this many iterations (0 : no)", "0");
+    parser.parse(argc, argv);
+
+    GraphModel model;
+    string output = parser.value("output");
+    int parts = parser.value_to_int("parts");
+    int gold = parser.value_to_int("gold");
+    model.nodes = parser.value_to_int("nodes");
+    model.m = parser.value_to_int("degree");
+    model.edges = (int64_t)model.nodes * model.m;
+    model.seed = stoull(parser.value("seed"));
+    bool valid = graph_model_from_string(parser.value("model"), model.kind) &&
+                 sscanf(parser.value("rmat").c_str(), "%lf,%lf,%lf", &model.a, &model.b, &model.c) == 3;
+
+    if (!valid || output.empty() || model.nodes < 1 || model.m < 1 || gold < 0 ||
+        model.a + model.b + model.c > 1) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    if (model.edges > INT32_MAX) {
+        printf("%lld links do not fit the int32 row pointers of the CSR format\n", (long long)model.edges);
+        return EXIT_FAILURE;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool csr = output.size() > 4 && output.compare(output.size() - 4, 4, ".csr") == 0;
+    if (!csr && !write_edges(model, output)) return EXIT_FAILURE;
+
+    if (csr || gold > 0) {
+        if (parts < 1 || parts > model.nodes) {
+            printf("%d parts do not fit %d pages\n", parts, model.nodes);
+            return EXIT_FAILURE;
+        }
+        CsrGraph g;
+        auto each_chunk = [&](const function<void(const Edge*, size_t)>& fn) {
+            return for_each_generated_chunk(model, fn);
+        };
+        if (!csr_from_edge_chunks(each_chunk, model.nodes, parser.value("model"), g)) return EXIT_FAILURE;
+
+        CsrPartition partition = partition_csr(g, balanced_row_begin(g.row_ptr.data(), g.nodes, parts));
+        if (csr && !write_graph_file(output, partition)) return EXIT_FAILURE;
+        if (gold > 0 && !write_gold(partition, gold, output + ".gold")) return EXIT_FAILURE;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << output << " : " << parser.value("model") << ", " << model.nodes << " pages, " << model.edges
+         << " links, seed " << model.seed << "\n";
+    cout << "Generation time : " << elapsed.count() << " s\n";
+    return 0;
+}
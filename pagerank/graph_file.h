@@ -0,0 +1,248 @@
+/*******************************************************************************
+Description:
+   Binary graph file (*.csr) that the host can mmap and hand straight to
+   cl::Buffer(... CL_MEM_USE_HOST_PTR ...) without parsing or normalizing.
+
+   Layout, every section starts on a page boundary :
+     page 0      : GraphFileHeader + partition table
+     per part p  : row_ptr (rows + 1 int32, rebased to 0)
+                   col_idx (nnz int32, global page numbers)
+                   val     (nnz float, 1 / out_degree(source))
+
+   A part is one compute unit's chunk, so each CU's arrays are page aligned
+   for zero-copy host buffers and for O_DIRECT / P2P reads of a single chunk.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "sparse_graph.h"
+#include <cerrno>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const size_t graph_page_size = 4096;
+const uint32_t graph_file_version = 1;
+const uint32_t graph_max_parts = 64;
+const char graph_file_magic[8] = {'P', 'R', 'G', 'R', 'A', 'P', 'H', 0};
+
+struct GraphPartEntry {
+    uint64_t row_begin;
+    uint64_t rows;
+    uint64_t nnz;
+    uint64_t row_ptr_offset;
+    uint64_t col_idx_offset;
+    uint64_t val_offset;
+};
+
+struct GraphFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_parts;
+    uint64_t nodes;
+    uint64_t nnz;
+    uint64_t file_size;
+    GraphPartEntry parts[graph_max_parts];
+};
+
+static_assert(sizeof(GraphFileHeader) <= graph_page_size, "graph file header must fit in one page");
+
+inline uint64_t graph_page_align(uint64_t offset) {
+    return (offset + graph_page_size - 1) / graph_page_size * graph_page_size;
+}
+
+inline bool graph_pwrite(int fd, const void* data, size_t bytes, uint64_t offset) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes) {
+        ssize_t ret = pwrite(fd, p, bytes, offset);
+        if (ret <= 0) return false;
+        p += ret;
+        bytes -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+inline bool write_graph_file(const std::string& path, const CsrPartition& g) {
+    if (g.parts.size() > graph_max_parts) {
+        std::cerr << "ERROR: at most " << graph_max_parts << " parts fit in a graph file" << std::endl;
+        return false;
+    }
+
+    GraphFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, graph_file_magic, sizeof(header.magic));
+    header.version = graph_file_version;
+    header.num_parts = g.parts.size();
+    header.nodes = g.nodes;
+    header.nnz = g.nnz;
+
+    uint64_t offset = graph_page_size;
+    for (size_t i = 0; i < g.parts.size(); i++) {
+        const CsrPart& p = g.parts[i];
+        GraphPartEntry& e = header.parts[i];
+
+        e.row_begin = p.row_begin;
+        e.rows = p.rows;
+        e.nnz = p.nnz;
+        e.row_ptr_offset = offset;
+        e.col_idx_offset = offset = graph_page_align(offset + (p.rows + 1) * sizeof(int));
+        e.val_offset = offset = graph_page_align(offset + p.nnz * sizeof(int));
+        offset = graph_page_align(offset + p.nnz * sizeof(float));
+    }
+    header.file_size = offset;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: open " << path << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    bool ok = graph_pwrite(fd, &header, sizeof(header), 0);
+    for (size_t i = 0; ok && i < g.parts.size(); i++) {
+        const CsrPart& p = g.parts[i];
+        const GraphPartEntry& e = header.parts[i];
+
+        ok = graph_pwrite(fd, p.row_ptr, (p.rows + 1) * sizeof(int), e.row_ptr_offset) &&
+             graph_pwrite(fd, p.col_idx, p.nnz * sizeof(int), e.col_idx_offset) &&
+             graph_pwrite(fd, p.val, p.nnz * sizeof(float), e.val_offset);
+    }
+    // pad to a whole page so every section can be read with O_DIRECT
+    ok = ok && ftruncate(fd, header.file_size) == 0;
+    if (!ok) std::cerr << "ERROR: write " << path << " failed: " << strerror(errno) << std::endl;
+
+    close(fd);
+    return ok;
+}
+
+inline bool is_graph_file(const std::string& path) {
+    char magic[sizeof(graph_file_magic)] = {0};
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) return false;
+    bool ok = read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic);
+    close(fd);
+    return ok && memcmp(magic, graph_file_magic, sizeof(magic)) == 0;
+}
+
+// Keeps the mapping alive for as long as the CsrPartition pointing into it is used.
+class GraphFile {
+   public:
+    GraphFile() = default;
+    GraphFile(const GraphFile&) = delete;
+    GraphFile& operator=(const GraphFile&) = delete;
+    ~GraphFile() {
+        if (base_) munmap(base_, size_);
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "ERROR: open " << path << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(GraphFileHeader)) {
+            std::cerr << "ERROR: " << path << " is not a graph file" << std::endl;
+            close(fd);
+            return false;
+        }
+        size_ = st.st_size;
+        // private writable mapping : the runtime may pin the pages for DMA,
+        // nothing is ever written back to the file
+        base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (base_ == MAP_FAILED) {
+            base_ = nullptr;
+            std::cerr << "ERROR: mmap " << path << " failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        const GraphFileHeader* h = header();
+        if (memcmp(h->magic, graph_file_magic, sizeof(h->magic)) != 0 || h->version != graph_file_version ||
+            h->num_parts > graph_max_parts || h->file_size > size_) {
+            std::cerr << "ERROR: " << path << " is not a version " << graph_file_version << " graph file"
+                      << std::endl;
+            return false;
+        }
+        if (h->nodes > INT_MAX || h->nnz > INT_MAX) {
+            std::cerr << "ERROR: " << path << " : " << h->nodes << " pages, " << h->nnz
+                      << " links do not fit int32" << std::endl;
+            return false;
+        }
+        // the parts follow each other and cover every page, every CU writes its own rows
+        uint64_t row = 0, nnz = 0;
+        for (uint32_t i = 0; i < h->num_parts; i++) {
+            if (h->parts[i].row_begin != row || !part_valid(h->parts[i], h->nodes)) {
+                std::cerr << "ERROR: " << path << " : part " << i << " is out of range" << std::endl;
+                return false;
+            }
+            row += h->parts[i].rows;
+            nnz += h->parts[i].nnz;
+        }
+        if (row != h->nodes || nnz != h->nnz) {
+            std::cerr << "ERROR: " << path << " : the parts hold " << row << " pages and " << nnz << " links, not "
+                      << h->nodes << " and " << h->nnz << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    const GraphFileHeader* header() const { return static_cast<const GraphFileHeader*>(base_); }
+
+    CsrPartition partition() const {
+        const char* base = static_cast<const char*>(base_);
+        const GraphFileHeader* h = header();
+        CsrPartition g;
+
+        g.nodes = h->nodes;
+        g.nnz = h->nnz;
+        for (uint32_t i = 0; i < h->num_parts; i++) {
+            const GraphPartEntry& e = h->parts[i];
+            g.parts.push_back({(int)e.row_begin, (int)e.rows, (int64_t)e.nnz,
+                               reinterpret_cast<const int*>(base + e.row_ptr_offset),
+                               reinterpret_cast<const int*>(base + e.col_idx_offset),
+                               reinterpret_cast<const float*>(base + e.val_offset)});
+        }
+        mark_dangling(g);
+        return g;
+    }
+
+   private:
+    bool section_valid(uint64_t offset, uint64_t bytes) const {
+        return offset % sizeof(int) == 0 && offset <= size_ && bytes <= size_ - offset;
+    }
+
+    // rows and sections inside the file, row_ptr non-decreasing from 0 to nnz, col_idx in [0, nodes)
+    bool part_valid(const GraphPartEntry& e, uint64_t nodes) const {
+        if (e.row_begin > nodes || e.rows > nodes - e.row_begin || e.nnz > INT_MAX) return false;
+        if (!section_valid(e.row_ptr_offset, (e.rows + 1) * sizeof(int)) ||
+            !section_valid(e.col_idx_offset, e.nnz * sizeof(int)) ||
+            !section_valid(e.val_offset, e.nnz * sizeof(float))) {
+            return false;
+        }
+        const char* base = static_cast<const char*>(base_);
+        const int* row_ptr = reinterpret_cast<const int*>(base + e.row_ptr_offset);
+        const int* col_idx = reinterpret_cast<const int*>(base + e.col_idx_offset);
+        if (row_ptr[0] != 0 || (uint64_t)row_ptr[e.rows] != e.nnz) return false;
+        for (uint64_t r = 0; r < e.rows; r++) {
+            if (row_ptr[r] > row_ptr[r + 1]) return false;
+        }
+        for (uint64_t k = 0; k < e.nnz; k++) {
+            if (col_idx[k] < 0 || (uint64_t)col_idx[k] >= nodes) return false;
+        }
+        return true;
+    }
+
+    void* base_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,117 @@
+/*******************************************************************************
+Description:
+   Synthetic power-law graphs for the Pagerank benchmarks.
+
+   rmat : R-MAT / Kronecker. Every edge picks one quadrant of the adjacency
+          matrix per level with probabilities a, b, c and 1 - a - b - c,
+          over 2^levels >= nodes ids. The ids are scrambled with a
+          bijection so the hubs are not all at the low page numbers, ids
+          past nodes are drawn again. In- and out-degrees are both skewed
+          and pages without out-links are common, like in a web crawl.
+   ba   : Barabasi-Albert preferential attachment. Page p links to m pages
+          picked in proportion to their degree so far. It uses the copy
+          model : edge slot 2i + 1 copies a random earlier slot, an even
+          slot holds the source of its edge. Following the copies back needs
+          only the hash of each slot, not the edges before it.
+
+   Every random draw is a hash of (seed, edge, draw), so edge i is the same
+   whatever the thread count or chunk size. for_each_generated_chunk() makes
+   the edges in parallel chunks and can be run again for the second pass of
+   csr_from_edge_chunks() instead of keeping the edge list in memory.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "sparse_graph.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct GraphModel {
+    enum Kind { rmat, ba } kind = rmat;
+    int nodes = 0;
+    int64_t edges = 0; // rmat : total, ba : nodes * m
+    int m = 1;         // ba : out-links per page
+    double a = 0.57, b = 0.19, c = 0.19;
+    uint64_t seed = 1;
+};
+
+const size_t gen_chunk_edges = 1 << 20;
+
+// splitmix64 of the three keys
+inline uint64_t gen_hash(uint64_t seed, uint64_t i, uint64_t k) {
+    uint64_t x = seed * 0x9e3779b97f4a7c15ULL ^ (i + 0x632be59bd9b4e019ULL) * 0xbf58476d1ce4e5b9ULL ^ k;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline double gen_unit(uint64_t seed, uint64_t i, uint64_t k) {
+    return (gen_hash(seed, i, k) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+inline int gen_levels(int nodes) {
+    int levels = 0;
+    while ((1LL << levels) < nodes) levels++;
+    return levels;
+}
+
+// Bijection of [0, 2^levels) : odd multiplier and xor shifts, all modulo 2^levels
+inline uint64_t gen_scramble(uint64_t v, int levels, uint64_t seed) {
+    uint64_t mask = (1ULL << levels) - 1;
+    v = (v * ((gen_hash(seed, 0, 0) | 1) & mask)) & mask;
+    v ^= v >> (levels / 2 + 1);
+    v = (v * ((gen_hash(seed, 1, 0) | 1) & mask)) & mask;
+    return v ^ (v >> (levels / 3 + 1));
+}
+
+inline Edge rmat_edge(const GraphModel& g, int64_t i) {
+    int levels = gen_levels(g.nodes);
+    uint64_t draw = 0;
+    for (;;) {
+        uint64_t src = 0, dst = 0;
+        for (int l = 0; l < levels; l++) {
+            double u = gen_unit(g.seed, i, draw++);
+            int quadrant = u < g.a ? 0 : u < g.a + g.b ? 1 : u < g.a + g.b + g.c ? 2 : 3;
+            src = src << 1 | (quadrant >> 1);
+            dst = dst << 1 | (quadrant & 1);
+        }
+        src = gen_scramble(src, levels, g.seed);
+        dst = gen_scramble(dst, levels, g.seed);
+        if (src < (uint64_t)g.nodes && dst < (uint64_t)g.nodes) return {(int)src, (int)dst};
+    }
+}
+
+inline Edge ba_edge(const GraphModel& g, int64_t i) {
+    // slot 2j holds the source of edge j, slot 2j + 1 a copy of a uniformly chosen earlier slot
+    uint64_t slot = 2 * (uint64_t)i + 1;
+    while (slot & 1) slot = gen_hash(g.seed, slot, 0) % slot;
+    return {(int)(i / g.m), (int)(slot / 2 / g.m)};
+}
+
+// Calls fn(const Edge* edges, size_t count) for the edges of g in order, gen_chunk_edges at a time.
+template <typename Fn>
+bool for_each_generated_chunk(const GraphModel& g, Fn fn) {
+    std::vector<Edge> chunk;
+    for (int64_t first = 0; first < g.edges; first += gen_chunk_edges) {
+        int64_t count = std::min<int64_t>(gen_chunk_edges, g.edges - first);
+        chunk.resize(count);
+#pragma omp parallel for schedule(static)
+        for (int64_t k = 0; k < count; k++) {
+            chunk[k] = g.kind == GraphModel::ba ? ba_edge(g, first + k) : rmat_edge(g, first + k);
+        }
+        fn(chunk.data(), chunk.size());
+    }
+    return true;
+}
+
+inline bool graph_model_from_string(const std::string& name, GraphModel::Kind& kind) {
+    if (name == "rmat") kind = GraphModel::rmat;
+    else if (name == "ba") kind = GraphModel::ba;
+    else return false;
+    return true;
+}
@@ -15,8 +15,18 @@
 */
 
 // OpenCL utility layer include
+#include "cmdlineparser.h"
 #include "xcl2.hpp"
+#include "bench.h"
+#include "cpu_engine.h"
+#include "edge_loader.h"
+#include "graph_file.h"
+#include "precision.h"
+#include "preprocess.h"
+#include "sparse_graph.h"
+#include "trace.h"
 #include <algorithm>
+#include <array>
 #include <cstdio>
 #include <random>
 #include <vector>
@@ -29,26 +39,75 @@ using std::generate;
 using std::uniform_int_distribution;
 using std::vector;
 
-const int columns = 2400;
-const int rows = 2400;
-const int iterations = 100;
+// set from the command line, dense cu3_pagerank holds at most MAX_SIZE pages
+int columns = 2400;
+int rows = 2400;
+int iterations = 100;
 const float d = 0.85;
 
-auto constexpr num_cu = 3;
+// kernel instances linked into the xclbin, queried once the device is programmed
+int num_cu = 0;
+auto constexpr max_dense_size = 2400;
+// rows per cu3_pagerank_tiled call, ROW_TILE in cu3_pagerank_tiled.cpp
+auto constexpr tile_rows = 256;
+// cu3_pagerank_wide : floats per 512-bit beat (LANES) and partial sums per row (ACC)
+auto constexpr wide_lanes = 16;
+auto constexpr wide_acc = 8;
+// default kernel clock, only used to turn kernel time into cycles per beat
+auto constexpr kernel_mhz = 300.0;
+
+//input : a[rows][columns], b[columns] output: b(= a * b);
+void matmul(const float *a, float *b) {
+	static vector<float> temp;
+	dense_step(a, b, columns, temp);
+}
 
-//input : a[row][columns], b[columns] output: b(= a * b);
-void matmul(float *a, float *b) {
-	//available optimization : store V value first and calculate
-	vector<float> temp(columns, 0);
+// Same as matmul for rows padded to stride columns, summed in the order of cu3_pagerank_wide :
+// an adder tree per beat of wide_lanes products, beat k into partial sum k % wide_acc, then a tree over those.
+// Rows [first, last) go to out[first ..].
+void wide_rows(const float *a, const float *b, float *out, int stride, int first, int last) {
+	vector<float> padded(stride, 0);
+	std::copy(b, b + columns, padded.begin());
+
+#pragma omp parallel for
+	for(int i = first; i < last; i++) {
+		float acc[wide_acc] = {0};
+		for(int k = 0; k < stride / wide_lanes; k++) {
+			float p[wide_lanes];
+			for(int l = 0; l < wide_lanes; l++) {
+				p[l] = a[(size_t)i * stride + k * wide_lanes + l] * padded[k * wide_lanes + l];
+			}
+			for(int w = wide_lanes / 2; w > 0; w /= 2) {
+				for(int l = 0; l < w; l++) {
+					p[l] = p[l] + p[l + w];
+				}
+			}
+			acc[k % wide_acc] += p[0];
+		}
+		for(int w = wide_acc / 2; w > 0; w /= 2) {
+			for(int l = 0; l < w; l++) {
+				acc[l] = acc[l] + acc[l + w];
+			}
+		}
+		out[i] = acc[0];
+	}
+}
 
-    for(int i = 0; i < rows; i++) {
-    	for(int j = 0; j < columns; j++) {
-    		temp[i] += a[i * rows + j] * b[j];
-    	}
-    }
+void matmul_wide(const float *a, float *b, int stride) {
+	vector<float> temp(rows, 0);
+
+	wide_rows(a, b, temp.data(), stride, 0, rows);
+	for(int i = 0; i < columns; i++)
+		b[i] = temp[i];
+}
 
-    for(int i = 0; i < columns; i++)
-    	b[i] = temp[i];
+// L1 distance between two rank vectors, the convergence measure
+double l1_residual(const float* a, const float* b, int n) {
+	double sum = 0;
+	for (int i = 0; i < n; i++) {
+		sum += std::fabs(a[i] - b[i]);
+	}
+	return sum;
 }
 
 int gen_random() {
@@ -86,14 +145,45 @@ void norm(float *data, int columns, int rows) {
 
 	for(int r = 0; r < rows; r++){
 		for(int c = 0; c < columns; c++) {
-			data[r * columns + c] /= sum[c];
+			if (sum[c] != 0) {
+				data[r * columns + c] /= sum[c];
+			}
 		}
 	}
 }
 
-void verify(vector<float, aligned_allocator<float> >& gold, vector<float, aligned_allocator<float> >& output) {
+// Reads bytes at offset of an O_DIRECT fd straight into a new P2P buffer on the card : the data
+// goes SSD -> FPGA memory without a bounce through host DRAM. offset is page aligned, the read is
+// rounded up to whole pages (the .csr file is padded for that). An empty section still gets a one
+// page buffer, the runtime has no buffers of size 0, but nothing is read into it.
+bool p2p_read(const cl::Context& context, const cl::CommandQueue& q, int fd, uint64_t offset, size_t bytes,
+              cl::Buffer& buffer) {
+    cl_int err;
+    size_t size = graph_page_align(bytes ? bytes : 1);
+    size_t read_bytes = graph_page_align(bytes);
+    cl_mem_ext_ptr_t ext = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
+
+    OCL_CHECK(err, buffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX, size, &ext, &err));
+    char* p2pPtr;
+    OCL_CHECK(err, p2pPtr = (char*)q.enqueueMapBuffer(buffer, CL_TRUE, CL_MAP_WRITE, 0, size, nullptr, nullptr, &err));
+    for (size_t done = 0; done < read_bytes;) {
+        ssize_t ret = pread(fd, p2pPtr + done, read_bytes - done, offset + done);
+        if (ret <= 0) {
+            std::cerr << "ERR: pread failed: " << (ret < 0 ? strerror(errno) : "end of file") << std::endl;
+            OCL_CHECK(err, err = q.enqueueUnmapMemObject(buffer, p2pPtr));
+            return false;
+        }
+        done += ret;
+    }
+    OCL_CHECK(err, err = q.enqueueUnmapMemObject(buffer, p2pPtr));
+    return true;
+}
+
+// tol == 0 : bit exact, otherwise relative error bound
+void verify(vector<float, aligned_allocator<float> >& gold, vector<float, aligned_allocator<float> >& output,
+            float tol = 0) {
     for (int i = 0; i < (int)output.size(); i++) {
-        if (output[i] != gold[i]) {
+        if (tol == 0 ? output[i] != gold[i] : std::fabs(output[i] - gold[i]) > tol * std::fabs(gold[i])) {
             std::cout << "Mismatch " << i << ": gold: " << gold[i] << " device: " << output[i] << "\n";
             print(output.data(), 1, rows);
             exit(EXIT_FAILURE);
@@ -102,56 +192,119 @@ void verify(vector<float, aligned_allocator<float> >& gold, vector<float, aligne
 }
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <XCLBIN File>" << std::endl;
+    // Command Line Parser
+    sda::utils::CmdLineParser parser;
+
+    // Switches
+    //**************//"<Full Arg>",  "<Short Arg>", "<Description>", "<Default>"
+    parser.addSwitch("--xclbin_file", "-x", "input binary file string", "");
+    parser.addSwitch("--matrix", "-m", "link matrix layout : dense, wide (dense, 512-bit), tiled (dense, any size) or csr", "dense");
+    parser.addSwitch("--nodes", "-n", "number of pages", "2400");
+    parser.addSwitch("--degree", "-g", "out-links per page (csr only)", "10");
+    parser.addSwitch("--iterations", "-i", "number of iterations (upper bound with -t)", "100");
+    parser.addSwitch("--precision", "-q", "dense matrix storage : fp32, bf16, fp16, q16 or q8 (sums stay fp32)", "fp32");
+    parser.addSwitch("--tolerance", "-t", "stop once the L1 residual drops below this (0 : run all iterations)", "0");
+    parser.addSwitch("--persistent", "-p", "keep the rank vector on the device between iterations", "false", true);
+    parser.addSwitch("--checkpoint", "-c", "with -p, read the rank vector back every N iterations (0 : only at the end)",
+                     "0");
+    parser.addSwitch("--devices", "-e", "number of cards to shard the pages over (0 : every card found)", "1");
+    parser.addSwitch("--coexec", "-o",
+                     "share of every compute unit's rows the CPU computes meanwhile, adapted each iteration (0 : off)",
+                     "0");
+    parser.addSwitch("--ssd", "-s", "with a *.csr graph, load every chunk SSD -> FPGA with P2P instead of from host memory",
+                     "false", true);
+    parser.addSwitch("--graph", "-f", "graph to load instead of a random one (*.csr, text edge list or *.bin int32 pairs)",
+                     "");
+    parser.addSwitch("--compute_units", "-u", "compute units to use per card (0 : every one in the xclbin)", "0");
+    parser.addSwitch("--warmup", "-w", "iterations left out of the benchmark statistics", "0");
+    parser.addSwitch("--bench", "-b", "append host and device timings to this file (*.json : JSON lines, else CSV)", "");
+    parser.addSwitch("--prepared", "-k",
+                     "dense matrix cache : loaded when it was written for the same -n and -m, else written", "");
+    parser.addSwitch("--trace", "-r", "write a Chrome trace / Perfetto JSON timeline of every command to this file", "");
+    parser.parse(argc, argv);
+
+    std::string binaryFile = parser.value("xclbin_file");
+    std::string graphFile = parser.value("graph");
+    bool sparse = parser.value("matrix") == "csr" || !graphFile.empty();
+    bool tiled = !sparse && parser.value("matrix") == "tiled";
+    bool wide = !sparse && parser.value("matrix") == "wide";
+    Precision precision = Precision::fp32;
+    bool lowp = precision_from_string(parser.value("precision"), precision) && precision != Precision::fp32;
+    columns = rows = parser.value_to_int("nodes");
+    iterations = parser.value_to_int("iterations");
+    double tolerance = parser.value_to_double("tolerance");
+    bool persistent = parser.value_to_bool("persistent");
+    int checkpoint = parser.value_to_int("checkpoint");
+    double cpu_share = parser.value_to_double("coexec");
+    int max_devices = parser.value_to_int("devices");
+    bool p2p = parser.value_to_bool("ssd");
+    int max_cu = parser.value_to_int("compute_units");
+    int warmup = parser.value_to_int("warmup");
+    std::string benchFile = parser.value("bench");
+    std::string traceFile = parser.value("trace");
+    std::string cacheFile = parser.value("prepared");
+    Trace trace(!traceFile.empty());
+
+    if (binaryFile.empty() || (!sparse && !tiled && !wide && parser.value("matrix") != "dense") ||
+        !precision_from_string(parser.value("precision"), precision)) {
+        parser.printHelp();
+        return EXIT_FAILURE;
+    }
+    if (cpu_share < 0 || cpu_share >= 1 || (cpu_share > 0 && persistent)) {
+        std::cout << "-o takes a share in [0, 1) and needs the rank vector on the host, not -p\n";
+        return EXIT_FAILURE;
+    }
+    if (p2p && graphFile.empty()) {
+        std::cout << "-s loads a *.csr graph file given with -f\n";
+        return EXIT_FAILURE;
+    }
+    if (max_devices != 1 && persistent) {
+        std::cout << "-p keeps the rank vector on one card, it cannot be combined with -e\n";
+        return EXIT_FAILURE;
+    }
+    if (lowp && (sparse || tiled || wide)) {
+        std::cout << "-q " << parser.value("precision") << " is only available with -m dense\n";
+        return EXIT_FAILURE;
+    }
+    CsrGraph graph;
+    CsrPartition parts;
+    GraphFile mapped;
+    if (!graphFile.empty()) {
+    	std::chrono::steady_clock::time_point load_start = std::chrono::steady_clock::now();
+    	if (is_graph_file(graphFile)) {
+    		// already partitioned and normalized, map it and go
+    		if (!mapped.open(graphFile)) {
+    			return EXIT_FAILURE;
+    		}
+    		parts = mapped.partition();
+    		columns = rows = parts.nodes;
+    	} else if (p2p) {
+    		std::cout << "-s needs a *.csr graph file, convert " << graphFile << " first\n";
+    		return EXIT_FAILURE;
+    	} else {
+    		if (!csr_from_edge_file(graphFile, edge_format_of(graphFile), graph)) {
+    			return EXIT_FAILURE;
+    		}
+    		columns = rows = graph.nodes;
+    	}
+    	std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - load_start;
+    	std::cout << "Loaded " << graphFile << " : " << columns << " pages in " << load_time.count() << " s\n";
+    }
+
+    if (!sparse && !tiled && columns > max_dense_size) {
+        std::cout << "Dense cu3_pagerank holds at most " << max_dense_size << " pages, use -m tiled or -m csr\n";
         return EXIT_FAILURE;
     }
-    std::string binaryFile = argv[1];
 
     cl_int err;
-    cl::CommandQueue q;
-    cl::Context context;
+    // one entry per card in use
+    std::vector<cl::CommandQueue> queues;
+    std::vector<cl::Context> contexts;
 
     //make kernels
-    std::vector<cl::Kernel> krnls(num_cu);
-
-    cl::Program program;
-
-    /*******************************************************************************
-    *
-   	*	Make data
-   	*
-  	*******************************************************************************/
-
-    vector<float, aligned_allocator<float>> M(columns * rows);
-	vector<float, aligned_allocator<float>> V(columns);
-	vector<float, aligned_allocator<float>> C(columns, 0);
-	uint32_t repeat_counter = iterations;
-
-    generate(begin(M), end(M), gen_random);
-    generate(begin(V), end(V), gen_random);
-
-    norm(M.data(), columns, rows);
-
-    for(int i = 0; i < rows * columns; i++) {
-		M[i] = d * M[i] + (1-d) / columns;
-	}
-
-    norm(V.data(), 1, rows);
-	vector<float, aligned_allocator<float>> gold = { V.begin(), V.end() };
-
-	/*******************************************************************************
-	*
-	*	Check host execution time
-	*
-	*******************************************************************************/
-
-	std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
-    for(int i = 0; i < iterations; i++)
-    	matmul(M.data(), gold.data());
-    std::chrono::system_clock::time_point end = std::chrono::system_clock::now();
-	std::chrono::nanoseconds nano = end - start;
+    std::vector<cl::Kernel> krnls;
 
+    std::vector<cl::Program> programs;
 
     /*******************************************************************************
 	*
@@ -168,18 +321,25 @@ int main(int argc, char** argv) {
 
     for (unsigned int i = 0; i < devices.size(); i++) {
         auto device = devices[i];
+        cl::Context context;
+        cl::CommandQueue q;
         // Creating Context and Command Queue for selected Device
         OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
         OCL_CHECK(err, q = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE |
         		CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err));
         std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
-        program = cl::Program(context, {device}, bins, nullptr, &err);
+        cl::Program program(context, {device}, bins, nullptr, &err);
         if (err != CL_SUCCESS) {
             std::cout << "Failed to program device[" << i << "] with xclbin file!\n";
         } else {
             std::cout << "Device[" << i << "]: program successful!\n";
             valid_device = true;
-            break; // we break because we found a valid device
+            contexts.push_back(context);
+            queues.push_back(q);
+            programs.push_back(program);
+            if ((int)programs.size() == max_devices) {
+                break; // we break because we found enough devices
+            }
         }
     }
     if (!valid_device) {
@@ -187,23 +347,189 @@ int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
 
-    for (int i = 0; i < num_cu; i++) {
-    	OCL_CHECK(err, krnls[i] = cl::Kernel(program, "cu3_pagerank", &err));
+    // one cl::Kernel per compute unit, named explicitly so each enqueue lands on its own instance
+    std::string kernel_name = sparse ? "cu3_pagerank_csr"
+                            : tiled  ? "cu3_pagerank_tiled"
+                            : wide   ? "cu3_pagerank_wide"
+                            : lowp   ? "cu3_pagerank_lp"
+                                     : "cu3_pagerank";
+    cl_uint cu_count = 0;
+    cl::Kernel probe;
+    OCL_CHECK(err, probe = cl::Kernel(programs[0], kernel_name.c_str(), &err));
+    OCL_CHECK(err, err = probe.getInfo(CL_KERNEL_COMPUTE_UNIT_COUNT, &cu_count));
+    num_cu = max_cu > 0 ? std::min<int>(cu_count, max_cu) : cu_count;
+    // every card runs the same xclbin, each shard is one compute unit of one card
+    int num_devices = programs.size();
+    int num_slots = num_cu * num_devices;
+    if (num_cu < 1 || num_slots > rows) {
+    	std::cout << binaryFile << " has " << num_cu << " " << kernel_name << " compute units for " << rows
+    	          << " pages\n";
+    	return EXIT_FAILURE;
     }
+    if (!parts.parts.empty() && (int)parts.parts.size() != num_slots) {
+    	std::cout << graphFile << " has " << parts.parts.size() << " parts, convert it for " << num_slots
+    	          << " compute units\n";
+    	return EXIT_FAILURE;
+    }
+    std::cout << "Using " << num_cu << " " << kernel_name << " compute units on " << num_devices << " device(s)\n";
+
+
+    /*******************************************************************************
+    *
+   	*	Make data
+   	*
+  	*******************************************************************************/
+
+    vector<float, aligned_allocator<float>> M;
+	vector<float, aligned_allocator<float>> V(columns);
+	vector<float, aligned_allocator<float>> C(columns, 0);
+
+	if (sparse && graphFile.empty()) {
+		// teleport stays a scalar, only the links are stored
+		graph = csr_from_edges(columns, gen_random_edges(columns, parser.value_to_int("degree")));
+	}
+
+	// rows [row_begin[i], row_begin[i + 1]) belong to task i, one task per compute unit of every
+	// card (so each card gets a contiguous row range) except with -m tiled where the tile
+	// scheduler deals row tiles out round robin
+	std::vector<int> row_begin;
+	if (!parts.parts.empty()) {
+		for (const CsrPart& part : parts.parts) {
+			row_begin.push_back(part.row_begin);
+		}
+		row_begin.push_back(rows);
+	} else if (sparse) {
+		// split by nonzeros, the rows of a power-law graph are anything but equal work
+		row_begin = balanced_row_begin(graph.row_ptr.data(), rows, num_slots);
+		parts = partition_csr(graph, row_begin);
+	} else if (tiled) {
+		for (int r = 0; r < rows; r += tile_rows) {
+			row_begin.push_back(r);
+		}
+		row_begin.push_back(rows);
+	} else {
+		row_begin = even_row_begin(rows, num_slots);
+	}
+	int num_tasks = row_begin.size() - 1;
+	// card of every task
+	std::vector<int> task_dev(num_tasks);
+
+	for (int i = 0; i < num_tasks; i++) {
+		int slot = i % num_slots;
+		task_dev[i] = slot / num_cu;
+		if (!tiled) {
+			std::cout << "Device " << task_dev[i] << " CU " << slot % num_cu << " : rows " << row_begin[i] << " - "
+			          << row_begin[i + 1];
+			if (sparse) {
+				std::cout << ", " << parts.parts[i].nnz << " links";
+			}
+			std::cout << "\n";
+		}
+		std::string cu_name = kernel_name + ":{" + kernel_name + "_" + std::to_string(slot % num_cu + 1) + "}";
+		krnls.emplace_back();
+		OCL_CHECK(err, krnls[i] = cl::Kernel(programs[task_dev[i]], cu_name.c_str(), &err));
+	}
+	if (tiled) {
+		std::cout << num_tasks << " row tiles of " << tile_rows << " rows\n";
+	}
+	if (sparse) {
+		std::cout << count_dangling(parts) << " dangling pages, their rank is spread over every page\n";
+	}
+
+	// row pitch of M on the device, cu3_pagerank_wide reads whole 512-bit beats
+	int stride = wide ? (columns + wide_lanes - 1) / wide_lanes * wide_lanes : columns;
+	if (!sparse) {
+		std::chrono::steady_clock::time_point prep_start = std::chrono::steady_clock::now();
+		uint32_t dangling = 0;
+		M.resize((size_t)rows * stride);
+		bool cached = !cacheFile.empty() && load_dense_cache(cacheFile, M.data(), V.data(), rows, columns, stride, d,
+		                                                      dangling);
+		if (!cached) {
+			// raw weights straight into M unless the rows get padded
+			vector<float, aligned_allocator<float>> padded(stride != columns ? (size_t)columns * rows : 0);
+			float* raw = stride != columns ? padded.data() : M.data();
+			generate(raw, raw + (size_t)columns * rows, gen_random);
+			generate(begin(V), end(V), gen_random);
+			norm(V.data(), 1, rows);
+			dangling = prepare_dense(raw, rows, columns, stride, d, M.data()).size();
+			if (!cacheFile.empty() && !save_dense_cache(cacheFile, M.data(), V.data(), rows, columns, stride, d, dangling)) {
+				return EXIT_FAILURE;
+			}
+		}
+		std::chrono::duration<double> prep_time = std::chrono::steady_clock::now() - prep_start;
+		std::cout << "Matrix " << (cached ? "loaded from " + cacheFile : std::string("prepared")) << " : " << dangling
+		          << " dangling pages, " << prep_time.count() << " s\n";
+	} else {
+		generate(begin(V), end(V), gen_random);
+		norm(V.data(), 1, rows);
+	}
+	// cu3_pagerank_lp gets the packed matrix, the host computes with the values it decodes to
+	// and keeps the fp32 matrix to report what the precision costs
+	vector<uint32_t, aligned_allocator<uint32_t>> Mq;
+	vector<float, aligned_allocator<float>> M32;
+	int words_per_row = (columns + elements_per_word(precision) - 1) / elements_per_word(precision);
+	float scale = 1;
+	if (lowp) {
+		scale = precision_scale(M.data(), M.size(), precision);
+		M32.swap(M);
+		pack_matrix(M32.data(), rows, columns, precision, scale, Mq, M);
+		std::cout << "Matrix stored as " << parser.value("precision") << " : " << Mq.size() * sizeof(uint32_t)
+		          << " bytes instead of " << M32.size() * sizeof(float) << "\n";
+	}
+
+	vector<float, aligned_allocator<float>> gold = { V.begin(), V.end() };
+	vector<float, aligned_allocator<float>> initial = { V.begin(), V.end() };
+	vector<float> prev;
+
+	/*******************************************************************************
+	*
+	*	Check host execution time
+	*
+	*******************************************************************************/
+
+	vector<float> scratch;
+	auto cpu_step = [&](float* v) {
+		if (sparse)
+			csr_step(parts, v, d, scratch);
+		else if (wide)
+			matmul_wide(M.data(), v, stride);
+		else
+			matmul(M.data(), v);
+	};
+
+	int gold_iters = 0;
+	vector<double> cpu_ns;
+    for(int i = 0; i < iterations; i++) {
+    	if (tolerance > 0) {
+    		prev.assign(gold.begin(), gold.end());
+    	}
+    	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    	cpu_step(gold.data());
+    	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    	std::chrono::nanoseconds nano = end - start;
+    	cpu_ns.push_back(nano.count());
+    	trace.host("cpu", "gold", i, start, end);
+    	gold_iters++;
+    	if (tolerance > 0 && l1_residual(prev.data(), gold.data(), columns) < tolerance) {
+    		break;
+    	}
+    }
+
+
 
 
 	std::cout << "|-------------------------+-------------------------|\n"
               << "| Host                    |    Wall-Clock Time (ns) |\n"
               << "|-------------------------+-------------------------|\n";
 
-	std::cout << "|" << std::left << std::setw(24) << "Host: "
-              << "|" << std::right << std::setw(24) << nano.count() / repeat_counter << " |\n";
+	std::string host_label = std::string("Host (") + cpu_isa_name(cpu_isa()) + "): ";
+	std::cout << "|" << std::left << std::setw(24) << host_label
+              << "|" << std::right << std::setw(24) << (uint64_t)bench_stats(cpu_ns, warmup).median_ns << " |\n";
 
     std::cout << "|-------------------------+-------------------------|\n"
               << "| Kernel                  |    Wall-Clock Time (ns) |\n"
               << "|-------------------------+-------------------------|\n";
 
-    std::vector<cl::Event> event(num_cu);
     uint64_t nstimestart, nstimeend, k_start, k_end;
 
     /*******************************************************************************
@@ -213,63 +539,358 @@ int main(int argc, char** argv) {
     *******************************************************************************/
 
     // compute the size of array in bytes
-    auto chunk_size = columns * rows / num_cu;
-    auto result_size = columns / num_cu;
-    size_t mat_size_bytes = chunk_size * sizeof(float);
     size_t vec_size_bytes = columns * sizeof(float);
-    size_t out_size_bytes = result_size * sizeof(float);
     uint64_t total_execution_time = 0;
 
-	std::vector<cl::Buffer> buffer_in1(num_cu);
-    std::vector<cl::Buffer> buffer_output(num_cu);
+	std::vector<cl::Buffer> buffer_in1(num_tasks);
+    std::vector<cl::Buffer> buffer_row_ptr(num_tasks), buffer_col_idx(num_tasks), buffer_val(num_tasks);
+    std::vector<cl::Buffer> buffer_residual(num_tasks);
+    std::vector<cl::Buffer> buffer_dangling(num_devices);
+    std::vector<std::vector<cl::Memory> > matrix_buffers(num_devices);
+    // a part without links still needs non-empty col_idx / val buffers, the runtime rejects size 0
+    std::vector<int, aligned_allocator<int> > no_col_idx(1, 0);
+    std::vector<float, aligned_allocator<float> > no_val(1, 0);
+
+    // -s : the chunks never touch host memory on the way to the card, the host only keeps
+    // its own mapping of the file for the gold result
+    int graph_fd = -1;
+    std::chrono::steady_clock::time_point p2p_start = std::chrono::steady_clock::now();
+    if (p2p) {
+    	graph_fd = open(graphFile.c_str(), O_RDONLY | O_DIRECT);
+    	if (graph_fd < 0) {
+    		std::cerr << "ERROR: open " << graphFile << " failed: " << strerror(errno) << std::endl;
+    		return EXIT_FAILURE;
+    	}
+    }
 
-	for (int i = 0; i < num_cu; i++) {
-    	OCL_CHECK(err, buffer_in1[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, mat_size_bytes,
-    		                                                  M.data() + i * chunk_size, &err));
-    	OCL_CHECK(err, buffer_output[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, out_size_bytes,
-    		                                                C.data() + i * result_size, &err));
+	for (int i = 0; i < num_tasks; i++) {
+		auto result_size = row_begin[i + 1] - row_begin[i];
+		cl::Context& context = contexts[task_dev[i]];
+		if (sparse) {
+			// each compute unit gets its own chunk of the CSR arrays
+			const CsrPart& part = parts.parts[i];
+			if (p2p) {
+				const GraphPartEntry& e = mapped.header()->parts[i];
+				cl::CommandQueue& q = queues[task_dev[i]];
+				if (!p2p_read(context, q, graph_fd, e.row_ptr_offset, (part.rows + 1) * sizeof(int), buffer_row_ptr[i]) ||
+				    !p2p_read(context, q, graph_fd, e.col_idx_offset, part.nnz * sizeof(int), buffer_col_idx[i]) ||
+				    !p2p_read(context, q, graph_fd, e.val_offset, part.nnz * sizeof(float), buffer_val[i])) {
+					return EXIT_FAILURE;
+				}
+			} else {
+				OCL_CHECK(err, buffer_row_ptr[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+				                                              (part.rows + 1) * sizeof(int),
+				                                              const_cast<int*>(part.row_ptr), &err));
+				size_t links = std::max<int64_t>(part.nnz, 1);
+				OCL_CHECK(err, buffer_col_idx[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+				                                              links * sizeof(int),
+				                                              part.nnz ? const_cast<int*>(part.col_idx)
+				                                                       : no_col_idx.data(), &err));
+				OCL_CHECK(err, buffer_val[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+				                                          links * sizeof(float),
+				                                          part.nnz ? const_cast<float*>(part.val) : no_val.data(),
+				                                          &err));
+				matrix_buffers[task_dev[i]].insert(matrix_buffers[task_dev[i]].end(),
+				                                   {buffer_row_ptr[i], buffer_col_idx[i], buffer_val[i]});
+			}
+		} else if (lowp) {
+			OCL_CHECK(err, buffer_in1[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+			                                          (size_t)result_size * words_per_row * sizeof(uint32_t),
+			                                          Mq.data() + (size_t)row_begin[i] * words_per_row, &err));
+			matrix_buffers[task_dev[i]].push_back(buffer_in1[i]);
+		} else {
+			OCL_CHECK(err, buffer_in1[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+			                                          (size_t)result_size * stride * sizeof(float),
+			                                          M.data() + (size_t)row_begin[i] * stride, &err));
+			matrix_buffers[task_dev[i]].push_back(buffer_in1[i]);
+		}
+    	OCL_CHECK(err, buffer_residual[i] = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float), nullptr, &err));
     }
-    OCL_CHECK(err, cl::Buffer buffer_in2(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, vec_size_bytes, V.data(), &err));
+    for (int dev = 0; sparse && dev < num_devices; dev++) {
+    	// every compute unit sums the rank of the dangling pages of the whole input vector
+    	OCL_CHECK(err, buffer_dangling[dev] = cl::Buffer(contexts[dev], CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+    	                                                 parts.dangling.size() * sizeof(uint32_t),
+    	                                                 parts.dangling.data(), &err));
+    	matrix_buffers[dev].push_back(buffer_dangling[dev]);
+    }
+    if (p2p) {
+    	for (int dev = 0; dev < num_devices; dev++) {
+    		OCL_CHECK(err, err = queues[dev].finish());
+    	}
+    	close(graph_fd);
+    	std::chrono::steady_clock::time_point p2p_end = std::chrono::steady_clock::now();
+    	std::chrono::duration<double> p2p_time = p2p_end - p2p_start;
+    	trace.host("main", "P2P load SSD -> FPGA", -1, p2p_start, p2p_end);
+    	double bytes = parts.nnz * (sizeof(int) + sizeof(float)) + (rows + num_tasks) * sizeof(int);
+    	std::cout << "P2P load SSD -> FPGA : " << bytes / p2p_time.count() / 1e6 << " MB/s (" << p2p_time.count() << " s)\n";
+    }
+
+    // Rank vectors : every compute unit reads the whole input and writes its rows of the output.
+    // Iteration k reads buffer_vec[k % 2] and writes buffer_vec[(k + 1) % 2] with -p,
+    // otherwise always V -> C with a round trip through the host. With several cards each
+    // has its own pair over the same host vectors, the host merge is the exchange.
+    std::vector<std::array<cl::Buffer, 2> > buffer_vec(num_devices);
+    for (int dev = 0; dev < num_devices; dev++) {
+    	OCL_CHECK(err, buffer_vec[dev][0] = cl::Buffer(contexts[dev], CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE,
+    	                                               vec_size_bytes, V.data(), &err));
+    	OCL_CHECK(err, buffer_vec[dev][1] = cl::Buffer(contexts[dev], CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE,
+    	                                               vec_size_bytes, C.data(), &err));
+    }
+    int in_arg = sparse ? 3 : 1;
+    int out_arg = sparse ? 4 : 2;
 
-	for (int i = 0; i < num_cu; i++) {
+	for (int i = 0; i < num_tasks; i++) {
+		int result_size = row_begin[i + 1] - row_begin[i];
     	// Setting kernel arguments
-    	OCL_CHECK(err, err = krnls[i].setArg(0, buffer_in1[i]));
-    	OCL_CHECK(err, err = krnls[i].setArg(1, buffer_in2));
-    	OCL_CHECK(err, err = krnls[i].setArg(2, buffer_output[i]));
-    	OCL_CHECK(err, err = krnls[i].setArg(3, columns));
-    	OCL_CHECK(err, err = krnls[i].setArg(4, result_size));
+		if (sparse) {
+			OCL_CHECK(err, err = krnls[i].setArg(0, buffer_row_ptr[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(1, buffer_col_idx[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(2, buffer_val[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(5, row_begin[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(6, result_size));
+			OCL_CHECK(err, err = krnls[i].setArg(7, d));
+			OCL_CHECK(err, err = krnls[i].setArg(8, columns));
+			OCL_CHECK(err, err = krnls[i].setArg(9, buffer_residual[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(10, buffer_dangling[task_dev[i]]));
+		} else {
+			OCL_CHECK(err, err = krnls[i].setArg(0, buffer_in1[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(3, columns));
+			OCL_CHECK(err, err = krnls[i].setArg(4, result_size));
+			OCL_CHECK(err, err = krnls[i].setArg(5, row_begin[i]));
+			OCL_CHECK(err, err = krnls[i].setArg(6, buffer_residual[i]));
+			if (lowp) {
+				OCL_CHECK(err, err = krnls[i].setArg(7, static_cast<int>(precision)));
+				OCL_CHECK(err, err = krnls[i].setArg(8, scale));
+			}
+		}
   	}
 
-    for(int iters = 0; iters < iterations; iters++) {
-    	for (int i = 0; i < num_cu; i++) {
-    	    // Copy input data to device global memory
-    	    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_in1[i], buffer_in2}, 0 /* 0 means from host*/));
+    /*
+     * The loop is submitted as an event graph, there is no queue-wide barrier
+     * inside it. Kernels of an iteration wait for the input vector, each
+     * compute unit's read-backs wait only for its own kernel, and with -p the
+     * next iteration waits only for the previous kernels plus the read-backs
+     * of the buffers it is about to overwrite. Without -t the host never
+     * blocks in -p mode, so the device sees back-to-back kernels.
+     * Events only chain within a card, ready[dev] and reads[dev] are per card.
+     */
+    std::vector<std::vector<cl::Event> > kernel_events;
+    std::vector<std::vector<cl::Event> > ready(num_devices), reads(num_devices);
+    std::vector<cl::Event> matrix_event(num_devices), prev_reads;
+    vector<float> R((size_t)iterations * num_tasks);
+
+    /*
+     * Co-execution (-o) : the device computes the first dev_rows[i] rows of task i and the
+     * CPU the rest, in between submitting the iteration and waiting for it. Afterwards the
+     * CPU share is set so both sides would have needed the same time, from the CPU time
+     * and the kernel timestamps of this iteration. Work is counted in rows, plus links for csr.
+     */
+    bool coexec = cpu_share > 0;
+    vector<int> dev_rows(num_tasks);
+    vector<double> cpu_residual(num_tasks);
+    vector<double> shares;
+    int size_arg = sparse ? 6 : 4;
+    auto work = [&](int i, int first, int last) {
+    	int64_t w = last - first;
+    	if (sparse) {
+    		w += parts.parts[i].row_ptr[last] - parts.parts[i].row_ptr[first];
+    	}
+    	return w;
+    };
+    auto split = [&](double share) {
+    	for (int i = 0; i < num_tasks; i++) {
+    		int n = row_begin[i + 1] - row_begin[i];
+    		int64_t target = (int64_t)std::llround((1 - share) * work(i, 0, n));
+    		int lo = 1, hi = n;
+    		while (lo < hi) {
+    			int mid = lo + (hi - lo) / 2;
+    			if (work(i, 0, mid) < target)
+    				lo = mid + 1;
+    			else
+    				hi = mid;
+    		}
+    		dev_rows[i] = lo;
+    	}
+    };
+    // rows [row_begin[i] + dev_rows[i], row_begin[i + 1]) of C from V, returns their L1 residual
+    auto cpu_tail = [&](int i, float tele) {
+    	int first = row_begin[i] + dev_rows[i], last = row_begin[i + 1];
+    	if (first == last) {
+    		return 0.0;
+    	}
+    	if (sparse)
+    		csr_part_rows(parts.parts[i], dev_rows[i], last - row_begin[i], V.data(), C.data(), d, tele);
+    	else if (wide)
+    		wide_rows(M.data(), V.data(), C.data(), stride, first, last);
+    	else
+    		dense_matvec(M.data() + (size_t)first * columns, V.data(), C.data() + first, last - first, columns);
+    	return l1_residual(V.data() + first, C.data() + first, last - first);
+    };
+    split(cpu_share);
+
+    // The matrix never changes, copy it once (with -s only the dangling mask, the links came with P2P)
+    for (int dev = 0; dev < num_devices; dev++) {
+    	OCL_CHECK(err, err = queues[dev].enqueueMigrateMemObjects(matrix_buffers[dev], 0 /* 0 means from host*/,
+    	                                                          nullptr, &matrix_event[dev]));
+    	trace.command(matrix_event[dev], dev, "migrate", "matrix -> device", -1);
+    }
+    if (persistent) {
+    	ready[0].assign(2, matrix_event[0]);
+    	OCL_CHECK(err, err = queues[0].enqueueMigrateMemObjects({buffer_vec[0][0]}, 0, nullptr, &ready[0][1]));
+    	trace.command(ready[0][1], 0, "migrate", "V -> device", -1);
+    }
+
+    int iters = 0;
+    double residual = 0;
+    // false until a residual has been read back (with -p that is one iteration late)
+    bool residual_valid = false;
+    while (iters < iterations) {
+    	int src = persistent ? iters % 2 : 0;
+    	std::vector<cl::Event> done(num_tasks);
+
+    	for (int dev = 0; !persistent && dev < num_devices; dev++) {
+    		// Copy input data to device global memory
+    		ready[dev].assign(2, matrix_event[dev]);
+    		OCL_CHECK(err, err = queues[dev].enqueueMigrateMemObjects({buffer_vec[dev][0]}, 0 /* 0 means from host*/,
+    		                                                          nullptr, &ready[dev][1]));
+    		trace.command(ready[dev][1], dev, "migrate", "V -> device", iters);
     	}
-    	OCL_CHECK(err, err = q.finish());
 
-    	for (int i = 0; i < num_cu; i++) {
+    	for (int i = 0; i < num_tasks; i++) {
+    		int dev = task_dev[i];
+    		OCL_CHECK(err, err = krnls[i].setArg(in_arg, buffer_vec[dev][src]));
+    		OCL_CHECK(err, err = krnls[i].setArg(out_arg, buffer_vec[dev][1 - src]));
+    		if (coexec) {
+    			OCL_CHECK(err, err = krnls[i].setArg(size_arg, dev_rows[i]));
+    		}
     		// Launch the kernel
-    		OCL_CHECK(err, err = q.enqueueTask(krnls[i], nullptr, &event[i]));
+    		OCL_CHECK(err, err = queues[dev].enqueueTask(krnls[i], &ready[dev], &done[i]));
+    		trace.command(done[i], dev, "cu " + std::to_string(i % num_slots % num_cu + 1),
+    		              tiled ? kernel_name + " tile " + std::to_string(i) : kernel_name, iters);
     	}
-    	OCL_CHECK(err, err = q.finish());
 
-    	// Copy result from device global memory to host local memory
-    	for (int i = 0; i < num_cu; i++) {
-    		OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_output[i]}, CL_MIGRATE_MEM_OBJECT_HOST));
+    	// Each compute unit's results come back as soon as its own kernel is done; with -p only
+    	// the residual comes back unless a checkpoint is due
+    	for (int dev = 0; dev < num_devices; dev++) {
+    		reads[dev].clear();
     	}
-    	OCL_CHECK(err, err = q.finish());
+    	for (int i = 0; i < num_tasks; i++) {
+    		cl::CommandQueue& q = queues[task_dev[i]];
+    		std::vector<cl::Event>& read = reads[task_dev[i]];
+    		std::vector<cl::Event> mine = {done[i]};
+    		size_t offset = row_begin[i] * sizeof(float);
+    		size_t bytes = (coexec ? dev_rows[i] : row_begin[i + 1] - row_begin[i]) * sizeof(float);
+
+    		read.emplace_back();
+    		OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_residual[i], CL_FALSE, 0, sizeof(float),
+    		                                         &R[(size_t)iters * num_tasks + i], &mine, &read.back()));
+    		trace.command(read.back(), task_dev[i], "read", "residual " + std::to_string(i), iters);
+    		if (!persistent) {
+    			read.emplace_back();
+    			OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_vec[task_dev[i]][1], CL_FALSE, offset, bytes,
+    			                                         C.data() + row_begin[i], &mine, &read.back()));
+    			trace.command(read.back(), task_dev[i], "read", "C rows " + std::to_string(i), iters);
+    		}
+    	}
+    	if (persistent && checkpoint > 0 && (iters + 1) % checkpoint == 0) {
+    		reads[0].emplace_back();
+    		OCL_CHECK(err, err = queues[0].enqueueMigrateMemObjects({buffer_vec[0][1 - src]}, CL_MIGRATE_MEM_OBJECT_HOST,
+    		                                                        &done, &reads[0].back()));
+    		trace.command(reads[0].back(), 0, "migrate", "checkpoint -> host", iters);
+    	}
+    	kernel_events.push_back(done);
+    	iters++;
+
+    	if (!persistent) {
+    		if (coexec) {
+    			std::chrono::steady_clock::time_point cpu_start = std::chrono::steady_clock::now();
+    			int64_t cpu_work = 0, dev_work = 0;
+    			float tele = sparse ? teleport(V.data(), parts.dangling.data(), columns, d) : 0;
+    			for (int i = 0; i < num_tasks; i++) {
+    				cpu_residual[i] = cpu_tail(i, tele);
+    				cpu_work += work(i, dev_rows[i], row_begin[i + 1] - row_begin[i]);
+    				dev_work += work(i, 0, dev_rows[i]);
+    			}
+    			std::chrono::steady_clock::time_point cpu_end = std::chrono::steady_clock::now();
+    			std::chrono::nanoseconds cpu_ns = cpu_end - cpu_start;
+    			trace.host("cpu", "co-exec rows", iters - 1, cpu_start, cpu_end);
+    			for (int dev = 0; dev < num_devices; dev++) {
+    				OCL_CHECK(err, err = cl::Event::waitForEvents(reads[dev]));
+    			}
+    			trace.host("main", "wait for reads", iters - 1, cpu_end, std::chrono::steady_clock::now());
+
+    			uint64_t dev_start = UINT64_MAX, dev_end = 0;
+    			for (int i = 0; i < num_tasks; i++) {
+    				R[(size_t)(iters - 1) * num_tasks + i] += cpu_residual[i];
+    				OCL_CHECK(err, err = done[i].getProfilingInfo<uint64_t>(CL_PROFILING_COMMAND_START, &nstimestart));
+    				OCL_CHECK(err, err = done[i].getProfilingInfo<uint64_t>(CL_PROFILING_COMMAND_END, &nstimeend));
+    				dev_start = std::min(dev_start, nstimestart);
+    				dev_end = std::max(dev_end, nstimeend);
+    			}
+    			shares.push_back(cpu_share);
+    			// work per ns on each side, the next share gives both the same finishing time
+    			double cpu_rate = cpu_work / std::max(1.0, (double)cpu_ns.count());
+    			double dev_rate = dev_work / std::max(1.0, (double)(dev_end - dev_start));
+    			cpu_share = std::min(0.9, std::max(0.01, cpu_rate / (cpu_rate + dev_rate)));
+    			split(cpu_share);
+    		} else {
+    			std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+    			for (int dev = 0; dev < num_devices; dev++) {
+    				OCL_CHECK(err, err = cl::Event::waitForEvents(reads[dev]));
+    			}
+    			trace.host("main", "wait for reads", iters - 1, wait_start, std::chrono::steady_clock::now());
+    		}
+    		residual = 0;
+    		for (int i = 0; i < num_tasks; i++) {
+    			residual += R[(size_t)(iters - 1) * num_tasks + i];
+    		}
+    		residual_valid = true;
 
-    	//Copy the total result to input for next iterations
-    	for(int col = 0; col < columns; col++) {
-    		V[col] = C[col];
+    		//Copy the total result to input for next iterations
+    		std::chrono::steady_clock::time_point copy_start = std::chrono::steady_clock::now();
+    		for(int col = 0; col < columns; col++) {
+    			V[col] = C[col];
+    		}
+    		trace.host("main", "copy C -> V", iters - 1, copy_start, std::chrono::steady_clock::now());
+    	} else {
+    		ready[0] = done;
+    		ready[0].insert(ready[0].end(), reads[0].begin(), reads[0].end());
+
+    		// Check the previous iteration while this one runs, at most one extra iteration is spent
+    		if (tolerance > 0 && iters >= 2) {
+    			std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+    			OCL_CHECK(err, err = cl::Event::waitForEvents(prev_reads));
+    			trace.host("main", "wait for residual", iters - 2, wait_start, std::chrono::steady_clock::now());
+    			residual = 0;
+    			for (int i = 0; i < num_tasks; i++) {
+    				residual += R[(size_t)(iters - 2) * num_tasks + i];
+    			}
+    			residual_valid = true;
+    		}
+    		prev_reads = reads[0];
     	}
+    	if (tolerance > 0 && residual_valid && residual < tolerance) {
+    		break;
+    	}
+    }
+    std::chrono::steady_clock::time_point finish_start = std::chrono::steady_clock::now();
+    for (int dev = 0; dev < num_devices; dev++) {
+    	OCL_CHECK(err, err = queues[dev].finish());
+    }
+    trace.host("main", "finish", -1, finish_start, std::chrono::steady_clock::now());
 
+    uint64_t first_start = 0, last_end = 0, busy = 0;
+    vector<double> device_ns;
+    for (int k = 0; k < iters; k++) {
+    	std::vector<cl::Event>& event = kernel_events[k];
     	OCL_CHECK(err, err = event[0].getProfilingInfo<uint64_t>(CL_PROFILING_COMMAND_START, &k_start));
     	OCL_CHECK(err, err = event[0].getProfilingInfo<uint64_t>(CL_PROFILING_COMMAND_END, &k_end));
+    	busy += k_end - k_start;
 
-    	for(int i = 1; i < num_cu; i++) {
+    	for(int i = 1; i < num_tasks; i++) {
     		OCL_CHECK(err, err = event[i].getProfilingInfo<uint64_t>(CL_PROFILING_COMMAND_START, &nstimestart));
     		OCL_CHECK(err, err = event[i].getProfilingInfo<uint64_t>(CL_PROFILING_COMMAND_END, &nstimeend));
+    		busy += nstimeend - nstimestart;
 
     		if(k_start > nstimestart) {
     			k_start = nstimestart;
@@ -279,17 +900,116 @@ int main(int argc, char** argv) {
     		}
     	}
     	total_execution_time += k_end - k_start;
+    	device_ns.push_back(k_end - k_start);
+    	if (k == 0) {
+    		first_start = k_start;
+    	}
+    	last_end = std::max(last_end, k_end);
 
-    	std::cout << std::setw(3) << iters << "th time : " << k_end - k_start << "\n";
+    	residual = 0;
+    	for (int i = 0; i < num_tasks; i++) {
+    		residual += R[(size_t)k * num_tasks + i];
+    	}
+    	std::cout << std::setw(3) << k << "th time : " << k_end - k_start << "  residual : " << residual;
+    	if (coexec) {
+    		std::cout << "  cpu share : " << shares[k];
+    	}
+    	std::cout << "\n";
     }
 
+    if (tolerance > 0) {
+    	std::cout << (residual < tolerance ? "Converged" : "Not converged") << " after " << iters
+    	          << " iterations, residual " << residual << " (tolerance " << tolerance << ")\n";
+    }
+    if (persistent) {
+    	// The result is in whichever buffer the last iteration wrote
+    	int last = iters % 2;
+    	cl::Event result;
+    	OCL_CHECK(err, err = queues[0].enqueueMigrateMemObjects({buffer_vec[0][last]}, CL_MIGRATE_MEM_OBJECT_HOST,
+    	                                                        nullptr, &result));
+    	trace.command(result, 0, "migrate", "result -> host", -1);
+    	OCL_CHECK(err, err = queues[0].finish());
+    	if (last == 0) {
+    		C.assign(V.begin(), V.end());
+    	}
+    }
+    if (iters != gold_iters) {
+    	// rounding moved the stopping point by an iteration, compare like with like
+    	gold.assign(initial.begin(), initial.end());
+    	for (int i = 0; i < iters; i++) {
+    		cpu_step(gold.data());
+    	}
+    }
+    // before verify(), which exits on a mismatch : that is when the timeline is wanted most
+    if (!trace.write(traceFile)) {
+    	return EXIT_FAILURE;
+    }
     verify(gold, C);
 
+    if (lowp) {
+    	// same iterations with the fp32 matrix
+    	M.swap(M32);
+    	gold.assign(initial.begin(), initial.end());
+    	for (int i = 0; i < iters; i++) {
+    		matmul(M.data(), gold.data());
+    	}
+    	double max_rel = 0;
+    	for (int i = 0; i < columns; i++) {
+    		max_rel = std::max(max_rel, std::fabs((double)C[i] - gold[i]) / std::fabs(gold[i]));
+    	}
+    	std::cout << parser.value("precision") << " vs fp32 matrix : L1 distance " << l1_residual(gold.data(), C.data(), columns)
+    	          << ", max relative error " << max_rel << "\n";
+    }
+
     std::cout << "| " << std::left << std::setw(24) << "total : "
               << "|" << std::right << std::setw(24) << total_execution_time << " |\n";
     std::cout << "| " << std::left << std::setw(24) << "avg per iters : "
-              << "|" << std::right << std::setw(24) << total_execution_time / repeat_counter << " |\n";
+              << "|" << std::right << std::setw(24) << total_execution_time / iters << " |\n";
+    std::cout << "| " << std::left << std::setw(24) << "first start to last end : "
+              << "|" << std::right << std::setw(24) << last_end - first_start << " |\n";
     std::cout << "|-------------------------+-------------------------|\n";
+    if (!sparse) {
+    	// every iteration streams all of M once; busy cycles per 512-bit beat is the achieved II of cu3_pagerank_wide
+    	double row_bytes = lowp ? words_per_row * sizeof(uint32_t) : stride * sizeof(float);
+    	double matrix_bytes = rows * row_bytes * iters;
+    	double beats = matrix_bytes / (wide_lanes * sizeof(float));
+    	std::cout << "Matrix bandwidth : " << matrix_bytes / (last_end - first_start) << " GB/s over all compute units\n";
+    	if (wide) {
+    		std::cout << "Achieved II : " << busy * kernel_mhz / 1000 / beats << " cycles per 512-bit beat at "
+    		          << kernel_mhz << " MHz\n";
+    	}
+    }
+    if (!benchFile.empty()) {
+    	// every iteration reads the matrix and the input vector and writes the output vector
+    	BenchRecord record;
+    	record.matrix = parser.value("matrix");
+    	record.precision = parser.value("precision");
+    	record.nodes = rows;
+    	record.warmup = warmup;
+    	if (sparse) {
+    		record.matrix = "csr";
+    		record.links = parts.nnz;
+    		record.bytes = parts.nnz * (sizeof(int) + sizeof(float)) + (rows + num_tasks) * sizeof(int) +
+    		               parts.dangling.size() * sizeof(uint32_t);
+    	} else {
+    		record.links = (int64_t)rows * columns;
+    		record.bytes = (double)rows * (lowp ? words_per_row * sizeof(uint32_t) : stride * sizeof(float));
+    	}
+    	record.bytes += 2.0 * columns * sizeof(float);
+
+    	record.engine = std::string("cpu-") + cpu_isa_name(cpu_isa());
+    	record.ns = cpu_ns;
+    	if (!bench_append(benchFile, record)) {
+    		return EXIT_FAILURE;
+    	}
+    	record.engine = xcl::is_emulation() ? "emu" : "fpga";
+    	record.compute_units = num_cu;
+    	record.devices = num_devices;
+    	record.ns = device_ns;
+    	if (!bench_append(benchFile, record)) {
+    		return EXIT_FAILURE;
+    	}
+    }
     std::cout << "Note: Wall Clock Time is meaningful for real hardware execution "
               << "only, not for emulation.\n";
     std::cout << "Please refer to profile summary for kernel execution time for "
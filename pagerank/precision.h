@@ -0,0 +1,145 @@
+/*******************************************************************************
+Description:
+   Reduced precision storage of the dense link matrix for cu3_pagerank_lp.
+   Only the stored matrix loses precision, products and sums stay fp32 :
+     bf16 : upper 16 bits of the float (round to nearest even)
+     fp16 : IEEE half, subnormals kept (the teleport share (1 - d) / N is
+            below the smallest normal half for N > ~2500)
+     q16  : unsigned fixed point, value = q * scale, scale = max / 65535
+     q8   : unsigned fixed point, value = q * scale, scale = max / 255
+   Elements are packed into 32-bit words (2 x 16 bit or 4 x 8 bit), low
+   bits first, and every row starts on a new word. decode_element() is
+   bit for bit what the kernel does.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// values of cu3_pagerank_lp's format argument
+enum class Precision { bf16 = 0, fp16 = 1, q16 = 2, q8 = 3, fp32 = 4 };
+
+inline bool precision_from_string(const std::string& name, Precision& p) {
+    const char* names[] = {"bf16", "fp16", "q16", "q8", "fp32"};
+    for (int i = 0; i < 5; i++) {
+        if (name == names[i]) {
+            p = static_cast<Precision>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int precision_bits(Precision p) {
+    return p == Precision::fp32 ? 32 : p == Precision::q8 ? 8 : 16;
+}
+
+inline int elements_per_word(Precision p) {
+    return 32 / precision_bits(p);
+}
+
+inline uint32_t float_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bits_float(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline uint32_t encode_bf16(float f) {
+    uint32_t u = float_bits(f);
+    return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+}
+
+inline uint32_t encode_fp16(float f) {
+    uint32_t u = float_bits(f);
+    uint32_t sign = (u >> 16) & 0x8000;
+    float a = std::fabs(f);
+
+    if (a >= 65520.0f) return sign | 0x7c00;
+    if (a < 6.103515625e-05f) {
+        // subnormal : multiples of 2^-24
+        return sign | (uint32_t)std::nearbyint(a * 16777216.0f);
+    }
+    int e = ((u >> 23) & 0xff) - 127 + 15;
+    uint32_t m = u & 0x7fffff;
+    uint32_t h = (e << 10) | (m >> 13);
+    uint32_t rest = m & 0x1fff;
+    // round to nearest even, a carry into the exponent is still correct
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+    return sign | h;
+}
+
+inline float decode_element(uint32_t bits, Precision p, float scale) {
+    switch (p) {
+        case Precision::bf16:
+            return bits_float(bits << 16);
+        case Precision::fp16: {
+            uint32_t sign = (bits & 0x8000) << 16;
+            uint32_t e = (bits >> 10) & 0x1f;
+            uint32_t m = bits & 0x3ff;
+            if (e == 0) {
+                float v = m * 5.9604644775390625e-08f;
+                return sign ? -v : v;
+            }
+            return bits_float(sign | ((e + 127 - 15) << 23) | (m << 13));
+        }
+        case Precision::q16:
+        case Precision::q8:
+            return bits * scale;
+        default:
+            return bits_float(bits);
+    }
+}
+
+// Fixed point step, the largest magnitude maps to the top code.
+inline float precision_scale(const float* m, size_t n, Precision p) {
+    float top = 0;
+    for (size_t i = 0; i < n; i++) top = std::max(top, std::fabs(m[i]));
+    if (top == 0) top = 1;
+    return p == Precision::q16 ? top / 65535 : p == Precision::q8 ? top / 255 : 1;
+}
+
+inline uint32_t encode_element(float f, Precision p, float scale) {
+    switch (p) {
+        case Precision::bf16:
+            return encode_bf16(f);
+        case Precision::fp16:
+            return encode_fp16(f);
+        case Precision::q16:
+        case Precision::q8:
+            return (uint32_t)std::max(0.0f, std::nearbyint(f / scale));
+        default:
+            return float_bits(f);
+    }
+}
+
+// Packs m[rows][columns] row by row; words_per_row = ceil(columns / elements_per_word).
+// decoded gets the values the kernel will actually multiply with.
+template <typename WordVec, typename FloatVec>
+void pack_matrix(const float* m, int rows, int columns, Precision p, float scale, WordVec& packed,
+                 FloatVec& decoded) {
+    int per = elements_per_word(p);
+    int bits = precision_bits(p);
+    size_t words_per_row = (columns + per - 1) / per;
+
+    packed.assign(rows * words_per_row, 0);
+    decoded.assign((size_t)rows * columns, 0);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            uint32_t q = encode_element(m[(size_t)r * columns + c], p, scale);
+            packed[r * words_per_row + c / per] |= q << (bits * (c % per));
+            decoded[(size_t)r * columns + c] = decode_element(q, p, scale);
+        }
+    }
+}
@@ -0,0 +1,152 @@
+/*******************************************************************************
+Description:
+   Dense link matrix preprocessing for host : column normalization, damping
+   and the device row pitch in one parallel pass, plus a cache file so the
+   prepared matrix can be reused by later runs.
+
+   prepare_dense() turns raw link weights a[rows][cols] into
+
+       out[r * stride + c] = d * a[r][c] / sum(a[.][c]) + (1 - d) / cols
+
+   Column sums are taken over tiles of columns, one tile per thread, every
+   column still summed in row order in double, so the result is the same
+   bit for bit on any thread count. A column without links (a dangling
+   page) links to every page instead : its entries become 1 / rows before
+   the damping. The second pass writes whole rows, in place or into the
+   padded pitch of cu3_pagerank_wide.
+
+   The cache holds the prepared matrix and the initial rank vector behind a
+   header with the sizes, the pitch and d; a file written for any other
+   configuration is not loaded.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// columns per tile of the column sums : one 4 KB page of every row
+const int prepare_tile_cols = 1024;
+
+// sum[c] of a[rows][cols]
+inline void column_sums(const float* a, int rows, int cols, std::vector<double>& sum) {
+    sum.assign(cols, 0);
+#pragma omp parallel for schedule(dynamic)
+    for (int first = 0; first < cols; first += prepare_tile_cols) {
+        int last = std::min(cols, first + prepare_tile_cols);
+        double* s = sum.data();
+        for (int r = 0; r < rows; r++) {
+            const float* row = a + (size_t)r * cols;
+            for (int c = first; c < last; c++) s[c] += row[c];
+        }
+    }
+}
+
+// Writes the prepared matrix to out (may be a itself when stride == cols, the padding columns of a
+// larger stride are zero) and returns the dangling columns.
+inline std::vector<int> prepare_dense(const float* a, int rows, int cols, int stride, float d, float* out) {
+    std::vector<double> sum;
+    std::vector<int> dangling;
+    column_sums(a, rows, cols, sum);
+    for (int c = 0; c < cols; c++) {
+        if (sum[c] == 0) dangling.push_back(c);
+    }
+
+    float uniform = 1.0f / rows;
+    float teleport = (1 - d) / cols;
+#pragma omp parallel for schedule(static)
+    for (int r = 0; r < rows; r++) {
+        const float* in = a + (size_t)r * cols;
+        float* row = out + (size_t)r * stride;
+        for (int c = 0; c < cols; c++) {
+            float m = sum[c] == 0 ? uniform : (float)(in[c] / sum[c]);
+            row[c] = d * m + teleport;
+        }
+        for (int c = cols; c < stride; c++) row[c] = 0;
+    }
+    return dangling;
+}
+
+const char dense_cache_magic[8] = {'P', 'R', 'D', 'E', 'N', 'S', 'E', 0};
+const uint32_t dense_cache_version = 1;
+const size_t dense_cache_page = 4096;
+
+struct DenseCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dangling;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t stride;
+    float d;
+    uint32_t reserved;
+};
+
+inline bool dense_cache_io(int fd, char* p, size_t bytes, uint64_t offset, bool write) {
+    while (bytes) {
+        ssize_t ret = write ? pwrite(fd, p, bytes, offset) : pread(fd, p, bytes, offset);
+        if (ret <= 0) return false;
+        p += ret;
+        bytes -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+// m[rows * stride] and v[cols] follow the header, each on a page boundary
+inline bool save_dense_cache(const std::string& path, const float* m, const float* v, int rows, int cols, int stride,
+                             float d, uint32_t dangling) {
+    DenseCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, dense_cache_magic, sizeof(h.magic));
+    h.version = dense_cache_version;
+    h.dangling = dangling;
+    h.rows = rows;
+    h.cols = cols;
+    h.stride = stride;
+    h.d = d;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: open " << path << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    size_t matrix_bytes = (size_t)rows * stride * sizeof(float);
+    uint64_t v_offset = dense_cache_page + (matrix_bytes + dense_cache_page - 1) / dense_cache_page * dense_cache_page;
+    bool ok = dense_cache_io(fd, (char*)&h, sizeof(h), 0, true) &&
+              dense_cache_io(fd, (char*)m, matrix_bytes, dense_cache_page, true) &&
+              dense_cache_io(fd, (char*)v, cols * sizeof(float), v_offset, true);
+    if (!ok) std::cerr << "ERROR: write " << path << " failed: " << strerror(errno) << std::endl;
+    close(fd);
+    return ok;
+}
+
+// false, without a message, when there is no cache for this configuration
+inline bool load_dense_cache(const std::string& path, float* m, float* v, int rows, int cols, int stride, float d,
+                             uint32_t& dangling) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    DenseCacheHeader h;
+    bool ok = dense_cache_io(fd, (char*)&h, sizeof(h), 0, false) &&
+              memcmp(h.magic, dense_cache_magic, sizeof(h.magic)) == 0 && h.version == dense_cache_version &&
+              h.rows == (uint64_t)rows && h.cols == (uint64_t)cols && h.stride == (uint64_t)stride && h.d == d;
+    size_t matrix_bytes = (size_t)rows * stride * sizeof(float);
+    uint64_t v_offset = dense_cache_page + (matrix_bytes + dense_cache_page - 1) / dense_cache_page * dense_cache_page;
+    if (ok) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        ok = dense_cache_io(fd, (char*)m, matrix_bytes, dense_cache_page, false) &&
+             dense_cache_io(fd, (char*)v, cols * sizeof(float), v_offset, false);
+        dangling = h.dangling;
+    }
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,257 @@
+/*******************************************************************************
+Description:
+   Sparse (CSR) link matrix for the Pagerank hosts.
+   Row r lists the in-links of page r and val holds the column-normalized
+   weight 1 / out_degree(src), so one Pagerank step is
+
+       v'[r] = d * sum(val[e] * v[col_idx[e]]) + (1 - d) / N * sum(v)
+                                                + d / N * sum(v[dangling])
+
+   A dangling page has no out-links and so no column in the matrix; its
+   rank is handed to every page equally, the last term. Together with the
+   teleport share that is a single scalar per iteration and is never
+   stored, which keeps memory and work proportional to the number of edges.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+// Page aligned storage so the arrays can back CL_MEM_USE_HOST_PTR buffers
+// without the runtime making a copy.
+template <typename T>
+struct page_allocator {
+    using value_type = T;
+
+    page_allocator() = default;
+    template <typename U>
+    page_allocator(const page_allocator<U>&) {}
+
+    T* allocate(std::size_t num) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, 4096, num * sizeof(T))) throw std::bad_alloc();
+        return reinterpret_cast<T*>(ptr);
+    }
+    void deallocate(T* p, std::size_t) { free(p); }
+
+    template <typename U>
+    bool operator==(const page_allocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const page_allocator<U>&) const { return false; }
+};
+
+template <typename T>
+using page_vector = std::vector<T, page_allocator<T> >;
+
+struct Edge {
+    int src;
+    int dst;
+};
+
+struct CsrGraph {
+    int nodes = 0;
+    page_vector<int> row_ptr; // nodes + 1 entries
+    page_vector<int> col_idx; // source page of every in-link
+    page_vector<float> val;   // 1 / out_degree(source)
+
+    size_t nnz() const { return col_idx.size(); }
+};
+
+// One compute unit's rows. row_ptr is rebased so the chunk can be handed to
+// cu3_pagerank_csr on its own; col_idx keeps the global page numbers.
+struct CsrPart {
+    int row_begin;
+    int rows;
+    int64_t nnz;
+    const int* row_ptr; // rows + 1 entries, row_ptr[0] == 0
+    const int* col_idx;
+    const float* val;
+};
+
+struct CsrPartition {
+    int nodes = 0;
+    int64_t nnz = 0;
+    std::vector<CsrPart> parts;
+    std::vector<page_vector<int> > row_ptr; // rebased row_ptr when built in memory
+    page_vector<uint32_t> dangling;         // bit p % 32 of word p / 32 : page p has no out-links
+};
+
+// A page without out-links is the source of no edge, so it appears in no col_idx.
+inline void mark_dangling(CsrPartition& g) {
+    g.dangling.assign((g.nodes + 31) / 32, ~0u);
+    if (g.nodes % 32) g.dangling.back() = (1u << (g.nodes % 32)) - 1;
+
+    uint32_t* mask = g.dangling.data();
+    for (const CsrPart& p : g.parts) {
+#pragma omp parallel for schedule(static)
+        for (int64_t e = 0; e < p.nnz; e++) {
+            int src = p.col_idx[e];
+#pragma omp atomic
+            mask[src / 32] &= ~(1u << (src % 32));
+        }
+    }
+}
+
+inline int count_dangling(const CsrPartition& g) {
+    int count = 0;
+    for (uint32_t w : g.dangling) count += __builtin_popcount(w);
+    return count;
+}
+
+// Counting sort of the edge list by destination.
+inline CsrGraph csr_from_edges(int nodes, const std::vector<Edge>& edges) {
+    CsrGraph g;
+    std::vector<int> out_degree(nodes, 0);
+
+    g.nodes = nodes;
+    g.row_ptr.assign(nodes + 1, 0);
+    for (const Edge& e : edges) {
+        g.row_ptr[e.dst + 1]++;
+        out_degree[e.src]++;
+    }
+    for (int r = 0; r < nodes; r++) g.row_ptr[r + 1] += g.row_ptr[r];
+
+    std::vector<int> cursor(g.row_ptr.begin(), g.row_ptr.end() - 1);
+    g.col_idx.resize(edges.size());
+    g.val.resize(edges.size());
+    for (const Edge& e : edges) {
+        int pos = cursor[e.dst]++;
+        g.col_idx[pos] = e.src;
+        g.val[pos] = 1.0f / out_degree[e.src];
+    }
+    return g;
+}
+
+// Keeps the nonzeros of an already column-normalized dense matrix m[r * nodes + c].
+inline CsrGraph csr_from_dense(const float* m, int nodes) {
+    CsrGraph g;
+
+    g.nodes = nodes;
+    g.row_ptr.assign(nodes + 1, 0);
+    for (int r = 0; r < nodes; r++) {
+        for (int c = 0; c < nodes; c++) {
+            if (m[(size_t)r * nodes + c] != 0) {
+                g.col_idx.push_back(c);
+                g.val.push_back(m[(size_t)r * nodes + c]);
+            }
+        }
+        g.row_ptr[r + 1] = g.col_idx.size();
+    }
+    return g;
+}
+
+// Every page links to `degree` uniformly chosen pages.
+inline std::vector<Edge> gen_random_edges(int nodes, int degree, unsigned seed = 1) {
+    std::default_random_engine e(seed);
+    std::uniform_int_distribution<int> dist(0, nodes - 1);
+    std::vector<Edge> edges;
+
+    edges.reserve((size_t)nodes * degree);
+    for (int src = 0; src < nodes; src++)
+        for (int k = 0; k < degree; k++) edges.push_back({src, dist(e)});
+    return edges;
+}
+
+// Equal row counts, for the dense matrix where every row costs the same. Any rows / parts works.
+inline std::vector<int> even_row_begin(int rows, int parts) {
+    std::vector<int> row_begin(parts + 1);
+    for (int i = 0; i <= parts; i++) row_begin[i] = (int64_t)rows * i / parts;
+    return row_begin;
+}
+
+// Row cost in cu3_pagerank_csr is one pipelined edge loop plus a fixed per-row
+// overhead, so split where row_ptr[r] + row_overhead * r crosses every 1 / parts
+// of the total. On power-law graphs an equal-row split leaves the compute units
+// that miss the hubs idle for most of the iteration.
+const int row_overhead = 1;
+
+inline std::vector<int> balanced_row_begin(const int* row_ptr, int rows, int parts) {
+    std::vector<int> row_begin(parts + 1, 0);
+    int64_t total = (int64_t)row_ptr[rows] + (int64_t)row_overhead * rows;
+
+    for (int i = 1; i < parts; i++) {
+        int64_t target = total * i / parts;
+        int lo = row_begin[i - 1], hi = rows;
+        // first row whose prefix cost reaches the target
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if ((int64_t)row_ptr[mid] + (int64_t)row_overhead * mid < target)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        // every compute unit keeps at least one row when rows >= parts
+        row_begin[i] = std::max(std::min(lo, rows - (parts - i)), std::min(row_begin[i - 1] + 1, rows));
+    }
+    row_begin[parts] = rows;
+    return row_begin;
+}
+
+// Splits g into chunks starting at row_begin[p]; row_begin has parts + 1 entries.
+// col_idx and val are shared with g, only row_ptr is copied.
+inline CsrPartition partition_csr(const CsrGraph& g, const std::vector<int>& row_begin) {
+    CsrPartition p;
+
+    p.nodes = g.nodes;
+    p.nnz = g.nnz();
+    for (size_t i = 0; i + 1 < row_begin.size(); i++) {
+        int first = row_begin[i], rows = row_begin[i + 1] - row_begin[i];
+        int base = g.row_ptr[first];
+
+        p.row_ptr.emplace_back(rows + 1);
+        for (int r = 0; r <= rows; r++) p.row_ptr.back()[r] = g.row_ptr[first + r] - base;
+        p.parts.push_back({first, rows, (int64_t)g.row_ptr[first + rows] - base, p.row_ptr.back().data(),
+                           g.col_idx.data() + base, g.val.data() + base});
+    }
+    mark_dangling(p);
+    return p;
+}
+
+// (1 - d) / N * sum(v) + d / N * sum(v[dangling]): the rank every page receives through
+// teleportation and from the dangling pages. Summed with the same interleaved float lanes as
+// cu3_pagerank_csr.
+const int teleport_lanes = 8;
+
+// The kernels round every multiply and add on its own, the CPU mirrors must not be contracted
+// into FMA (-march=native, -mfma) or they drift from the device by an ulp.
+#define PAGERANK_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+
+PAGERANK_NO_CONTRACT inline float teleport(const float* v, const uint32_t* dangling, int nodes, float d) {
+    float lane[teleport_lanes] = {0};
+    float mass_lane[teleport_lanes] = {0};
+    float total = 0, mass = 0;
+
+    for (int i = 0; i < nodes; i++) {
+        lane[i % teleport_lanes] += v[i];
+        mass_lane[i % teleport_lanes] += (dangling[i / 32] >> (i % 32)) & 1 ? v[i] : 0.0f;
+    }
+    for (int l = 0; l < teleport_lanes; l++) {
+        total += lane[l];
+        mass += mass_lane[l];
+    }
+    return (1 - d) / nodes * total + d / nodes * mass;
+}
+
+// The rows of one chunk, same arithmetic order as cu3_pagerank_csr. out is the full vector.
+PAGERANK_NO_CONTRACT inline void csr_rows(const CsrPart& p, const float* in, float* out, float d, float tele) {
+    for (int r = 0; r < p.rows; r++) {
+        float sum = 0;
+        for (int e = p.row_ptr[r]; e < p.row_ptr[r + 1]; e++) sum += p.val[e] * in[p.col_idx[e]];
+        out[p.row_begin + r] = d * sum + tele;
+    }
+}
+
+// v <- one Pagerank step of v.
+inline void csr_matmul(const CsrPartition& g, float* v, float d) {
+    std::vector<float> temp(g.nodes);
+    float tele = teleport(v, g.dangling.data(), g.nodes, d);
+
+    for (const CsrPart& p : g.parts) csr_rows(p, v, temp.data(), d, tele);
+    for (int i = 0; i < g.nodes; i++) v[i] = temp[i];
+}
@@ -0,0 +1,168 @@
+/*******************************************************************************
+Description:
+   Timeline of the host pipeline, written as Chrome trace JSON (open it in
+   chrome://tracing or ui.perfetto.dev).
+
+   command() is called right after every enqueue with the event it returned,
+   host() around every host side phase (waits, copies, CPU rows). Nothing is
+   queried while the pipeline runs; write() reads the QUEUED / SUBMIT /
+   START / END profiling timestamps once the queues are finished.
+
+   Device timestamps are moved onto the host steady_clock per card : a
+   command is queued before enqueue returns, so the smallest gap between
+   the host time after the call and CL_PROFILING_COMMAND_QUEUED is the
+   offset between the clocks.
+
+   Layout : process 0 is the host, process d + 1 card d, one row per lane
+   ("cu 1", "migrate", "read", ...). START -> END is a slice on its lane,
+   QUEUED -> START (waiting for dependencies and the device) an async slice
+   next to it, both carry the iteration and the queued / submit / start
+   gaps in their args.
+
+*******************************************************************************/
+
+#pragma once
+
+#include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class Trace {
+   public:
+    explicit Trace(bool enabled) : enabled_(enabled) {}
+
+    bool enabled() const { return enabled_; }
+
+    // iteration < 0 : not part of an iteration (setup, final read back)
+    void command(const cl::Event& event, int dev, const std::string& lane, const std::string& name, int iteration) {
+        if (!enabled_) return;
+        commands_.push_back({event, dev, lane, name, iteration, now()});
+    }
+
+    void host(const std::string& lane, const std::string& name, int iteration,
+              std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        if (!enabled_) return;
+        phases_.push_back({lane, name, iteration, ns(start), ns(end)});
+    }
+
+    // every traced command must be complete
+    bool write(const std::string& path) {
+        if (!enabled_) return true;
+
+        struct Times {
+            uint64_t queued, submit, start, end;
+        };
+        std::vector<Times> times(commands_.size());
+        std::map<int, int64_t> offset;
+        cl_int err;
+        for (size_t i = 0; i < commands_.size(); i++) {
+            const Command& c = commands_[i];
+            Times& t = times[i];
+            OCL_CHECK(err, err = c.event.getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, &t.queued));
+            OCL_CHECK(err, err = c.event.getProfilingInfo(CL_PROFILING_COMMAND_SUBMIT, &t.submit));
+            OCL_CHECK(err, err = c.event.getProfilingInfo(CL_PROFILING_COMMAND_START, &t.start));
+            OCL_CHECK(err, err = c.event.getProfilingInfo(CL_PROFILING_COMMAND_END, &t.end));
+            int64_t gap = (int64_t)c.enqueued - (int64_t)t.queued;
+            auto it = offset.find(c.dev);
+            if (it == offset.end() || gap < it->second) offset[c.dev] = gap;
+        }
+
+        // time 0 is the first thing that happened on any timeline
+        int64_t origin = INT64_MAX;
+        for (size_t i = 0; i < commands_.size(); i++) {
+            origin = std::min(origin, (int64_t)times[i].queued + offset[commands_[i].dev]);
+        }
+        for (const Phase& p : phases_) origin = std::min(origin, (int64_t)p.start);
+
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "ERROR: cannot write " << path << std::endl;
+            return false;
+        }
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}}";
+
+        // row ids, named the first time they are used
+        std::map<std::pair<int, std::string>, int> lanes;
+        std::set<int> named = {0};
+        auto tid = [&](int pid, const std::string& lane) {
+            auto key = std::make_pair(pid, lane);
+            auto it = lanes.find(key);
+            if (it != lanes.end()) return it->second;
+            int id = lanes.size() + 1;
+            lanes[key] = id;
+            if (named.insert(pid).second) {
+                out << ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+                    << ",\"args\":{\"name\":\"device " << pid - 1 << "\"}}";
+            }
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << id
+                << ",\"args\":{\"name\":\"" << lane << "\"}}";
+            return id;
+        };
+        auto us = [&](int64_t t) { return (t - origin) / 1000.0; };
+        auto iteration = [](int k) { return k < 0 ? std::string() : ",\"iteration\":" + std::to_string(k); };
+
+        out.precision(15);
+        for (const Phase& p : phases_) {
+            int t = tid(0, p.lane);
+            out << ",\n{\"name\":\"" << p.name << "\",\"cat\":\"host\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+                << ",\"ts\":" << us(p.start) << ",\"dur\":" << (p.end - p.start) / 1000.0 << ",\"args\":{\"lane\":\""
+                << p.lane << "\"" << iteration(p.iteration) << "}}";
+        }
+        for (size_t i = 0; i < commands_.size(); i++) {
+            const Command& c = commands_[i];
+            const Times& t = times[i];
+            int pid = c.dev + 1;
+            int id = tid(pid, c.lane);
+            int64_t shift = offset[c.dev];
+            std::string args = "{\"queued_to_submit_ns\":" + std::to_string(t.submit - t.queued) +
+                               ",\"submit_to_start_ns\":" + std::to_string(t.start - t.submit) +
+                               ",\"start_to_end_ns\":" + std::to_string(t.end - t.start) + iteration(c.iteration) +
+                               "}";
+            out << ",\n{\"name\":\"" << c.name << "\",\"cat\":\"device\",\"ph\":\"X\",\"pid\":" << pid
+                << ",\"tid\":" << id << ",\"ts\":" << us(t.start + shift) << ",\"dur\":" << (t.end - t.start) / 1000.0
+                << ",\"args\":" << args << "}";
+            out << ",\n{\"name\":\"" << c.name << " queued\",\"cat\":\"queue\",\"ph\":\"b\",\"id\":" << i
+                << ",\"pid\":" << pid << ",\"tid\":" << id << ",\"ts\":" << us(t.queued + shift)
+                << ",\"args\":" << args << "}";
+            out << ",\n{\"name\":\"" << c.name << " queued\",\"cat\":\"queue\",\"ph\":\"e\",\"id\":" << i
+                << ",\"pid\":" << pid << ",\"tid\":" << id << ",\"ts\":" << us(t.start + shift) << "}";
+        }
+        out << "\n]}\n";
+        std::cout << "Trace of " << commands_.size() << " commands and " << phases_.size() << " host phases : " << path
+                  << "\n";
+        return (bool)out;
+    }
+
+   private:
+    struct Command {
+        cl::Event event;
+        int dev;
+        std::string lane;
+        std::string name;
+        int iteration;
+        uint64_t enqueued;
+    };
+    struct Phase {
+        std::string lane;
+        std::string name;
+        int iteration;
+        uint64_t start, end;
+    };
+
+    static uint64_t ns(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+    static uint64_t now() { return ns(std::chrono::steady_clock::now()); }
+
+    bool enabled_;
+    std::vector<Command> commands_;
+    std::vector<Phase> phases_;
+};
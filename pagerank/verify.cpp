@@ -4,6 +4,8 @@
 #include <chrono>
 #include <iostream>
 
+#include "cpu_engine.h"
+
 using namespace std;
 
 void print(const char name[], vector<float> mat, int row, int col) {
@@ -17,18 +19,12 @@ void print(const char name[], vector<float> mat, int row, int col) {
     }
 }
 
-void matMul(vector<float> a, vector<float> &b, int row, int col) {
-    vector<float> temp(col, 0);
-
-    for(int i = 0; i < row; i++) {
-    	for(int j = 0; j < col; j++) {
-    		temp[i] += a[i * col + j] * b[j];
-
-    	}
-    }
+// b = a * b, a[row][col] with row == col
+void matMul(const vector<float> &a, vector<float> &b, int row, int col) {
+    vector<float> temp(row);
 
-    for(int i = 0; i < col; i++)
-    	b[i] = temp[i];
+    dense_matvec(a.data(), b.data(), temp.data(), row, col);
+    b.assign(temp.begin(), temp.end());
 }
 
 int main(int argc, char **argv) {
@@ -40,7 +36,7 @@ int main(int argc, char **argv) {
 
     scanf("%d %d %d", &rows, &columns, &iters);
 
-    vector<float> M(rows * columns);
+    vector<float> M((size_t)rows * columns);
     vector<float> V(columns);
     vector<float> gold(columns);
 
@@ -59,18 +55,31 @@ int main(int argc, char **argv) {
     //print("M", M, rows, columns);
     //print("V", V, rows,  1);
 
-    for(int i = 0; i < rows * columns; i++) {
+    // a page without out-links (an all zero column) links to every page, so its rank is not lost
+    int dangling = 0;
+    for(int c = 0; c < columns; c++) {
+        bool empty = true;
+        for(int r = 0; r < rows && empty; r++)
+            empty = M[(size_t)r * columns + c] == 0;
+        if (!empty)
+            continue;
+        dangling++;
+        for(int r = 0; r < rows; r++)
+            M[(size_t)r * columns + c] = 1.0f / rows;
+    }
+
+    for(size_t i = 0; i < M.size(); i++) {
 		M[i] = d * M[i] + (1-d) / columns;
 	}
         
  
     //print("M hat", M, rows, columns);
 
-    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     for(int i = 0; i < iters; i++) {
         matMul(M, V, rows, columns);
     }
-    std::chrono::system_clock::time_point end = std::chrono::system_clock::now();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 	std::chrono::nanoseconds nano = end - start;
    
     //print("result", V, rows, 1);
@@ -81,12 +90,15 @@ int main(int argc, char **argv) {
     for(int c = 0; c < columns;c++) {
         printf("%-12.10f|%-12.10f ", gold[c], V[c]);
 
-        printf("%c\n", (abs(gold[c] -  V[c]) >= diff) ? 'X' : 'O');
+        bool wrong = fabs(gold[c] - V[c]) >= diff;
+        ok = ok && !wrong;
+        printf("%c\n", wrong ? 'X' : 'O');
     }
 
     cout << "N : " << rows << "\n";
     cout << "Iterations : " << iters << '\n';
-    cout << "Host execution time : " << nano.count() << " \n";
+    cout << "Dangling pages : " << dangling << '\n';
+    cout << "Host execution time (" << cpu_isa_name(cpu_isa()) << ") : " << nano.count() << " \n";
     
     printf("%s\n", ok ? "ok" : "wrong");
     
@@ -0,0 +1,30 @@
+/*******************************************************************************
+Description:
+   Vector addition for the P2P example : c[i] = a[i] + b[i] for size ints.
+   a and b are P2P buffers filled straight from the SSD, c goes back to the
+   SSD the same way.
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define CHUNK 1048576
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = CHUNK;
+
+extern "C" {
+void adder(int* a, int* b, int* c, int size) {
+#pragma HLS INTERFACE m_axi port = a offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = b offset = slave bundle = gmem1 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = c offset = slave bundle = gmem0 max_write_burst_length = 64
+add:
+    for (int i = 0; i < size; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+        c[i] = a[i] + b[i];
+    }
+}
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+Description:
+   Near-storage aggregation : sum, count, min and max of one int column over
+   the rows with lo <= col[i] <= hi (lo = INT_MIN, hi = INT_MAX for all rows).
+   col holds count values straight from the SSD (P2P), only the 4 results of
+   the chunk cross PCIe :
+       out[0] = sum, out[1] = count, out[2] = min, out[3] = max
+   min / max of a chunk without a matching row are INT_MAX / INT_MIN, the
+   host folds the chunks together.
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define CHUNK 1048576
+#define INT_MAX_V 2147483647
+#define INT_MIN_V (-INT_MAX_V - 1)
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = CHUNK;
+
+extern "C" {
+void aggregate(int* col, long long* out, int count, int lo, int hi) {
+#pragma HLS INTERFACE m_axi port = col offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = out offset = slave bundle = gmem1
+    long long sum = 0;
+    long long n = 0;
+    int vmin = INT_MAX_V;
+    int vmax = INT_MIN_V;
+
+// Integer adds and compares close in one cycle, so II=1 needs no partial sums
+scan:
+    for (int i = 0; i < count; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+        int v = col[i];
+        if (v >= lo && v <= hi) {
+            sum += v;
+            n++;
+            vmin = v < vmin ? v : vmin;
+            vmax = v > vmax ? v : vmax;
+        }
+    }
+    out[0] = sum;
+    out[1] = n;
+    out[2] = vmin;
+    out[3] = vmax;
+}
+}
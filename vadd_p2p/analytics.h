@@ -0,0 +1,135 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+ * Launchers for the near-storage analytics kernels on an int column file :
+ *   filter_op    filter_select : row numbers with lo <= v <= hi -> sel file
+ *   aggregate_op aggregate     : sum / count / min / max of the matching rows
+ *   histogram_op histogram     : nbins counters of width, plus below / above
+ * Each returns a StreamOp for StreamRunner. The reductions fold the per chunk
+ * results into the Aggregate / Histogram the caller passes in, which must
+ * outlive the run. The *_cpu functions give the same answers on host memory.
+ */
+
+#pragma once
+
+#include "stream_op.h"
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// MAX_BINS of histogram.cpp
+const int histogram_max_bins = 256;
+
+struct Aggregate {
+    long long sum = 0;
+    long long count = 0;
+    int min = INT_MAX;
+    int max = INT_MIN;
+
+    void add(long long s, long long n, int lo, int hi) {
+        sum += s;
+        count += n;
+        min = lo < min ? lo : min;
+        max = hi > max ? hi : max;
+    }
+    bool operator==(const Aggregate& o) const {
+        return sum == o.sum && count == o.count && min == o.min && max == o.max;
+    }
+};
+
+struct Histogram {
+    int lo = 0;
+    int width = 1;
+    int nbins = 0;
+    // nbins counters, then below lo, then at or above the last bin
+    std::vector<uint64_t> bins;
+
+    Histogram(int lo_, int width_, int nbins_) : lo(lo_), width(width_), nbins(nbins_), bins(nbins_ + 2, 0) {}
+
+    int bin(int v) const {
+        if (v < lo) return nbins;
+        if ((long long)v >= lo + (long long)nbins * width) return nbins + 1;
+        return ((long long)v - lo) / width;
+    }
+};
+
+inline StreamOp filter_op(const std::string& column, const std::string& sel, int lo, int hi) {
+    StreamOp op;
+    op.kernel = "filter_select";
+    op.inputs = {{column, sizeof(int)}};
+    op.outputs = {{sel, sizeof(long long), StreamPort::compacted}};
+    op.pass_first = true;
+    op.scalars = [lo, hi](cl::Kernel& krnl, int arg) {
+        krnl.setArg(arg, lo);
+        krnl.setArg(arg + 1, hi);
+    };
+    return op;
+}
+
+inline StreamOp aggregate_op(const std::string& column, int lo, int hi, Aggregate& result) {
+    StreamOp op;
+    op.kernel = "aggregate";
+    op.inputs = {{column, sizeof(int)}};
+
+    StreamPort out;
+    out.kind = StreamPort::reduced;
+    out.reduce_bytes = 4 * sizeof(long long);
+    out.combine = [&result](const char* data) {
+        const long long* r = reinterpret_cast<const long long*>(data);
+        result.add(r[0], r[1], (int)r[2], (int)r[3]);
+    };
+    op.outputs = {out};
+    op.scalars = [lo, hi](cl::Kernel& krnl, int arg) {
+        krnl.setArg(arg, lo);
+        krnl.setArg(arg + 1, hi);
+    };
+    return op;
+}
+
+// result.nbins must be in [1, histogram_max_bins] and result.width > 0
+inline StreamOp histogram_op(const std::string& column, Histogram& result) {
+    StreamOp op;
+    op.kernel = "histogram";
+    op.inputs = {{column, sizeof(int)}};
+
+    StreamPort out;
+    out.kind = StreamPort::reduced;
+    out.reduce_bytes = (result.nbins + 2) * sizeof(unsigned int);
+    out.combine = [&result](const char* data) {
+        const unsigned int* b = reinterpret_cast<const unsigned int*>(data);
+        for (size_t i = 0; i < result.bins.size(); i++) result.bins[i] += b[i];
+    };
+    op.outputs = {out};
+    int lo = result.lo, width = result.width, nbins = result.nbins;
+    op.scalars = [lo, width, nbins](cl::Kernel& krnl, int arg) {
+        krnl.setArg(arg, lo);
+        krnl.setArg(arg + 1, width);
+        krnl.setArg(arg + 2, nbins);
+    };
+    return op;
+}
+
+inline void aggregate_cpu(const int* col, size_t n, int lo, int hi, Aggregate& result) {
+    for (size_t i = 0; i < n; i++) {
+        if (col[i] >= lo && col[i] <= hi) result.add(col[i], 1, col[i], col[i]);
+    }
+}
+
+inline void histogram_cpu(const int* col, size_t n, Histogram& result) {
+    for (size_t i = 0; i < n; i++) result.bins[result.bin(col[i])]++;
+}
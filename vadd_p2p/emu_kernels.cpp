@@ -0,0 +1,21 @@
+/*******************************************************************************
+Description:
+   Kernel registrations for the software-emulated device (common/emu/xcl2.hpp).
+   Linked into the host only for emulation builds, next to the kernel sources
+   of this directory.
+
+*******************************************************************************/
+
+#include "xcl2.hpp"
+
+extern "C" {
+void adder(int* a, int* b, int* c, int size);
+void filter_select(int* col, long long* sel, int* kept, int count, long long first, int lo, int hi);
+void aggregate(int* col, long long* out, int count, int lo, int hi);
+void histogram(int* col, unsigned int* bins, int count, int lo, int width, int nbins);
+}
+
+static bool registered = emu::register_kernel("adder", &adder) &&
+                         emu::register_kernel("filter_select", &filter_select) &&
+                         emu::register_kernel("aggregate", &aggregate) &&
+                         emu::register_kernel("histogram", &histogram);
@@ -0,0 +1,41 @@
+/*******************************************************************************
+Description:
+   Near-storage predicate filter with selection vector output.
+   col holds count values of one int column, straight from the SSD (P2P).
+   Every row with lo <= col[i] <= hi is kept : its row number first + i is
+   appended to sel and kept[0] is the number of rows kept, so only the
+   selection vector crosses PCIe, never the column.
+   = v is lo = hi = v, < v is lo = INT_MIN, hi = v - 1, and so on.
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define CHUNK 1048576
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = CHUNK;
+
+extern "C" {
+void filter_select(int* col, long long* sel, int* kept, int count, long long first, int lo, int hi) {
+#pragma HLS INTERFACE m_axi port = col offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = sel offset = slave bundle = gmem1 max_write_burst_length = 64
+#pragma HLS INTERFACE m_axi port = kept offset = slave bundle = gmem1
+    int n = 0;
+
+// One row per cycle, sel is only written for the rows that pass
+scan:
+    for (int i = 0; i < count; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+        int v = col[i];
+        if (v >= lo && v <= hi) {
+            sel[n] = first + i;
+            n++;
+        }
+    }
+    kept[0] = n;
+}
+}
@@ -0,0 +1,72 @@
+/*******************************************************************************
+Description:
+   Near-storage histogram of one int column.
+   col holds count values straight from the SSD (P2P). Bin b counts the
+   values in [lo + b * width, lo + (b + 1) * width) for b < nbins, and
+       bins[nbins]     = values below lo
+       bins[nbins + 1] = values at or above lo + nbins * width
+   so only nbins + 2 counters per chunk cross PCIe.
+   The counters live in BRAM : a value landing in the same bin as the one
+   before is added to a register instead, so the read-modify-write of one
+   bin never waits for the previous one and the loop keeps II=1.
+
+*******************************************************************************/
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+
+#define CHUNK 1048576
+#define MAX_BINS 256
+
+// TRIPCOUNT identifiers
+const unsigned int c_dim = CHUNK;
+const unsigned int b_dim = MAX_BINS + 2;
+
+extern "C" {
+void histogram(int* col, unsigned int* bins, int count, int lo, int width, int nbins) {
+#pragma HLS INTERFACE m_axi port = col offset = slave bundle = gmem0 max_read_burst_length = 64
+#pragma HLS INTERFACE m_axi port = bins offset = slave bundle = gmem1
+    unsigned int local[MAX_BINS + 2];
+    int prev = 0;
+    unsigned int run = 0;
+
+initBins:
+    for (int b = 0; b < nbins + 2; b++) {
+#pragma HLS LOOP_TRIPCOUNT min = b_dim max = b_dim
+#pragma HLS PIPELINE II=1
+        local[b] = 0;
+    }
+
+scan:
+    for (int i = 0; i < count; i++) {
+#pragma HLS LOOP_TRIPCOUNT min = c_dim max = c_dim
+#pragma HLS PIPELINE II=1
+#pragma HLS DEPENDENCE variable = local inter false
+        long long v = col[i];
+        int b;
+        if (v < lo)
+            b = nbins;
+        else if (v >= lo + (long long)nbins * width)
+            b = nbins + 1;
+        else
+            b = (v - lo) / width;
+
+        if (b == prev) {
+            run++;
+        } else {
+            local[prev] += run;
+            prev = b;
+            run = 1;
+        }
+    }
+    local[prev] += run;
+
+writeBins:
+    for (int b = 0; b < nbins + 2; b++) {
+#pragma HLS LOOP_TRIPCOUNT min = b_dim max = b_dim
+#pragma HLS PIPELINE II=1
+        bins[b] = local[b];
+    }
+}
+}
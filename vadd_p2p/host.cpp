@@ -15,7 +15,11 @@
 */
 
 // OpenCL utility layer include
+#include "analytics.h"
 #include "cmdlineparser.h"
+#include "nvme_io.h"
+#include "p2p_pool.h"
+#include "stream_op.h"
 #include "xcl2.hpp"
 #include <fcntl.h>
 #include <fstream>
@@ -25,155 +29,144 @@
 #include <unistd.h>
 #include <vector>
 #include <algorithm>
+#include <cstring>
 #include <ctime>
 
-#define DATA_SIZE 4096
 #define INCR_VALUE 10
 
+// Test vectors, the index makes every element distinct
+inline int value_a(size_t i) {
+    return 3 + i % 1000;
+}
+
+inline int value_b(size_t i) {
+    return 4 + i % 7;
+}
+
+// Writes size elements of A and B to the SSD, chunk elements at a time.
 void p2p_host_to_ssd(int& nvmeFd1, int& nvmeFd2,
-                     cl::Context context,
-                     cl::CommandQueue q,
-                     cl::Program program,
-                     std::vector<int, aligned_allocator<int> > source_input_A,
-					 std::vector<int, aligned_allocator<int> > source_input_B) {
-    int err;
-    int ret = 0;
-    int size = DATA_SIZE;
-    size_t vector_size_bytes = sizeof(int) * DATA_SIZE;
-
-    cl::Kernel krnl_vadd;
-    // Allocate Buffer in Global Memory
-    cl_mem_ext_ptr_t outExt;
-    outExt = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
-
-    OCL_CHECK(err, cl::Buffer input_a(context, CL_MEM_READ_ONLY, vector_size_bytes, nullptr, &err));
-    OCL_CHECK(err, cl::Buffer input_b(context, CL_MEM_READ_ONLY, vector_size_bytes, nullptr, &err));
-    //OCL_CHECK(err, cl::Buffer p2pBo(context, CL_MEM_WRITE_ONLY | CL_MEM_EXT_PTR_XILINX, vector_size_bytes, &outExt, &err));
-    //OCL_CHECK(err, krnl_vadd = cl::Kernel(program, "adder", &err));
-
-    int* inputPtr_A = (int*)q.enqueueMapBuffer(input_a, CL_TRUE, CL_MAP_WRITE | CL_MAP_READ, 0, vector_size_bytes,
-                                             nullptr, nullptr, &err);
-    int* inputPtr_B = (int*)q.enqueueMapBuffer(input_b, CL_TRUE, CL_MAP_WRITE | CL_MAP_READ, 0, vector_size_bytes,
-                                                 nullptr, nullptr, &err);
-
-    for (int i = 0; i < DATA_SIZE; i++) {
-        inputPtr_A[i] = source_input_A[i];
-        inputPtr_B[i] = source_input_B[i];
+                     P2PPool& pool,
+                     size_t size, size_t chunk) {
+    size_t vector_size_bytes = sizeof(int) * chunk;
+    P2PSlice input_a, input_b;
+
+    if (!pool.allocate(vector_size_bytes, CL_MEM_READ_ONLY, input_a) ||
+        !pool.allocate(vector_size_bytes, CL_MEM_READ_ONLY, input_b)) {
+        std::cerr << "ERROR: P2P pool too small for 2 buffers of " << vector_size_bytes << " bytes" << std::endl;
+        exit(EXIT_FAILURE);
     }
-
-    q.finish();
+    int* inputPtr_A = input_a.as<int>();
+    int* inputPtr_B = input_b.as<int>();
 
     std::cout << "Now start P2P Write from device buffers to SSD\n" << std::endl;
-    //save result twice for next step
-    ret = pwrite(nvmeFd1, (void*)inputPtr_A, vector_size_bytes, 0);
-    if (ret == -1) std::cout << "P2P: write() 1 failed, err: " << ret << ", line: " << __LINE__ << std::endl;
-    ret = pwrite(nvmeFd2, (void*)inputPtr_B, vector_size_bytes, 0);
-    if (ret == -1) std::cout << "P2P: write() 2 failed, err: " << ret << ", line: " << __LINE__ << std::endl;
+    for (size_t first = 0; first < size; first += chunk) {
+        size_t count = std::min(chunk, size - first);
+        for (size_t i = 0; i < count; i++) {
+            inputPtr_A[i] = value_a(first + i);
+            inputPtr_B[i] = value_b(first + i);
+        }
+        // the tail of the last chunk is padding, written only to keep O_DIRECT whole pages
+        size_t bytes = page_align(count * sizeof(int));
+        if (!full_pwrite(nvmeFd1, inputPtr_A, bytes, first * sizeof(int)))
+            std::cout << "P2P: write() 1 failed, err: " << strerror(errno) << ", line: " << __LINE__ << std::endl;
+        if (!full_pwrite(nvmeFd2, inputPtr_B, bytes, first * sizeof(int)))
+            std::cout << "P2P: write() 2 failed, err: " << strerror(errno) << ", line: " << __LINE__ << std::endl;
+    }
 
     std::cout << "Clean up the buffers\n" << std::endl;
+    pool.release(input_a);
+    pool.release(input_b);
 }
 
-void p2p_ssd_to_host(int& nvmeFd1, int &nvmeFd2, int &nvmeFd3,
-                     cl::Context context,
-                     cl::CommandQueue q,
-                     cl::Program program,
-                     std::vector<int, aligned_allocator<int> >* source_hw_results) {
-    int err, ret = 0;
-    int size = DATA_SIZE;
-    size_t vector_size_bytes = sizeof(int) * DATA_SIZE;
-
-    cl::Kernel krnl_vadd1;
-    // Allocate Buffer in Global Memory
-    cl_mem_ext_ptr_t inExt1, inExt2, outExt;
-    inExt1 = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
-    inExt2 = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
-    outExt = {0, nullptr, 0};
-
-    //load data(A +B) twice
-    OCL_CHECK(err, cl::Buffer buffer_input_a(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX, vector_size_bytes, &inExt1,
-                                           &err));
-    OCL_CHECK(err, cl::Buffer buffer_input_b(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX, vector_size_bytes, &inExt2,
-                                               &err));
-    OCL_CHECK(err, cl::Buffer buffer_output(context, CL_MEM_WRITE_ONLY | CL_MEM_EXT_PTR_XILINX, vector_size_bytes,
-                                            &outExt, &err));
-    OCL_CHECK(err, krnl_vadd1 = cl::Kernel(program, "adder", &err));
-
-    std::cout << "\nMap P2P device buffers to host access pointers\n" << std::endl;
-    void* p2pPtr1 = q.enqueueMapBuffer(buffer_input_a,      // buffer
-                                       CL_TRUE,           // blocking call
-                                       CL_MAP_READ,       // Indicates we will be writing
-                                       0,                 // buffer offset
-                                       vector_size_bytes, // size in bytes
-                                       nullptr, nullptr,
-                                       &err); // error code
-    void* p2pPtr2 = q.enqueueMapBuffer(buffer_input_b,      // buffer
-                                          CL_TRUE,           // blocking call
-                                          CL_MAP_READ,       // Indicates we will be writing
-                                          0,                 // buffer offset
-                                          vector_size_bytes, // size in bytes
-                                          nullptr, nullptr,
-                                          &err); // error code
+// C = A + B with the adder kernel : adder(int* a, int* b, int* c, int size)
+StreamOp adder_op(const std::string& dir) {
+    StreamOp op;
+    op.kernel = "adder";
+    op.inputs = {{dir + "/A.txt"}, {dir + "/B.txt"}};
+    op.outputs = {{dir + "/C.txt"}};
+    return op;
+}
 
+// Streams size elements of A.txt + B.txt into C.txt, see StreamRunner
+void p2p_ssd_to_host(StreamRunner& runner, const StreamOp& op, size_t size, size_t chunk, int depth) {
     std::cout << "Now start P2P Read from SSD to device buffers\n" << std::endl;
-    if (pread(nvmeFd1, (void*)p2pPtr1, vector_size_bytes, 0) <= 0) {
-        std::cerr << "ERR: pread 1 failed: "
-                  << " error: " << strerror(errno) << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    std::vector<int, aligned_allocator<int> > source_input_A_file(DATA_SIZE);
-    std::vector<int, aligned_allocator<int> > source_input_B_file(DATA_SIZE);
-    OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_input_a, CL_TRUE, 0, vector_size_bytes, source_input_A_file.data(),
-                                                 nullptr, nullptr));
-    std::cout << "\ncheck A.txt";
-    for(int i = 0; i < DATA_SIZE; i++) {
-    	if(i % 256 == 0) std::cout << '\n';
-    	std::cout << source_input_A_file[i] << ' ';
-    }
+    StreamStats stats = runner.run(op, size, chunk, depth);
 
-    if (pread(nvmeFd2, (void*)p2pPtr2, vector_size_bytes, 0) <= 0) {
-          std::cerr << "ERR: pread 2 failed: "
-                    << " error: " << strerror(errno) << std::endl;
-          exit(EXIT_FAILURE);
-    }
+    double gb = (stats.bytes_in + stats.bytes_out) / 1e9;
+    std::cout << "Streamed " << gb << " GB (" << stats.bytes_in / 1e9 << " in, " << stats.bytes_out / 1e9
+              << " out) in " << stats.seconds << " s : " << gb / stats.seconds << " GB/s\n";
+}
 
-    OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_input_b, CL_TRUE, 0, vector_size_bytes, source_input_B_file.data(),
-                                                     nullptr, nullptr));
+// C.txt against A + B, one chunk at a time so any size fits in host memory. The file is read into
+// host memory : the check needs nothing on the card, and a P2P slice would be read through the BAR.
+bool check_sum(const std::string& path, size_t size, size_t chunk) {
+    std::cout << "Check the C.txt\n";
+    std::vector<int, aligned_allocator<int> > check(page_align(chunk * sizeof(int)) / sizeof(int));
 
-    std::cout << "\ncheck B.txt";
-    for(int i = 0; i < DATA_SIZE; i++) {
-       	if(i % 256 == 0) std::cout << '\n';
-       	std::cout << source_input_B_file[i] << ' ';
+    int nvmeFd3 = open(path.c_str(), O_RDONLY | O_DIRECT);
+    if (nvmeFd3 < 0) {
+    	std::cerr << "ERROR: open " << path << " failed: " << strerror(errno) << std::endl;
+    	return false;
     }
 
+    bool num_matched = true;
+    for (size_t first = 0; first < size && num_matched; first += chunk) {
+        size_t count = std::min(chunk, size - first);
+        ssize_t got = full_pread(nvmeFd3, check.data(), page_align(count * sizeof(int)), first * sizeof(int));
+        if (got < 0) {
+            std::cerr << "ERR: pread of " << path << " failed: " << strerror(errno) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (got < (ssize_t)(count * sizeof(int))) {
+            std::cerr << "ERR: " << path << " ends before element " << first + count << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t idx = first + i;
+            if (check[i] != value_a(idx) + value_b(idx)) {
+                std::cout << "Error: Result mismatch" << std::endl;
+                std::cout << "i = " << idx << " CPU result = " << value_a(idx) + value_b(idx)
+                          << " Device result = " << check[i] << std::endl;
+                num_matched = false;
+                break;
+            }
+        }
+    }
+    (void)close(nvmeFd3);
+    return num_matched;
+}
 
-    // Set the Kernel Arguments
-    OCL_CHECK(err, err = krnl_vadd1.setArg(0, buffer_input_a));
-    OCL_CHECK(err, err = krnl_vadd1.setArg(1, buffer_input_b));
-    OCL_CHECK(err, err = krnl_vadd1.setArg(2, buffer_output));
-    OCL_CHECK(err, err = krnl_vadd1.setArg(3, size));
-
-    // Launch the Kernel
-    OCL_CHECK(err, err = q.enqueueTask(krnl_vadd1));
-
-    // Read output data to host
-    // (A + B)
-    OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_output, CL_TRUE, 0, vector_size_bytes, source_hw_results->data(),
-                                             nullptr, nullptr));
-    std::cout << "\nMap P2P device buffers to host access pointers\n" << std::endl;
-
-    std::cout << "\nWrite the result to device\n";
-    void* p2pPtr = q.enqueueMapBuffer(buffer_output,                      // buffer
-                                      CL_TRUE,                    // blocking call
-                                      CL_MAP_WRITE | CL_MAP_READ, // Indicates we will be writing
-                                      0,                          // buffer offset
-                                      vector_size_bytes,          // size in bytes
-                                      nullptr, nullptr,
-                                      &err); // error code
-    ret = pwrite(nvmeFd3, (void*)p2pPtr, vector_size_bytes, 0);
-    if (ret == -1) std::cout << "P2P: write() 3 failed, err: " << ret << ", line: " << __LINE__ << std::endl;
+// The selection vector against the rows of A with lo <= value <= hi
+bool check_filter(const std::string& path, size_t size, int lo, int hi) {
+    std::ifstream sel(path, std::ios::binary);
+    size_t kept = 0;
+    long long row;
+
+    for (size_t i = 0; i < size; i++) {
+        if (value_a(i) < lo || value_a(i) > hi) continue;
+        if (!sel.read(reinterpret_cast<char*>(&row), sizeof(row)) || row != (long long)i) {
+            std::cout << "Error: selection vector entry " << kept << " should be row " << i << std::endl;
+            return false;
+        }
+        kept++;
+    }
+    if (sel.read(reinterpret_cast<char*>(&row), sizeof(row))) {
+        std::cout << "Error: selection vector has more than " << kept << " rows" << std::endl;
+        return false;
+    }
+    std::cout << "Selected " << kept << " of " << size << " rows\n";
+    return true;
+}
 
-    std::cout << "Clean up the buffers\n" << std::endl;
+// A's values chunk by chunk, for the CPU side of the reductions
+template <typename F>
+void for_each_chunk_a(size_t size, size_t chunk, F f) {
+    std::vector<int> col(chunk);
+    for (size_t first = 0; first < size; first += chunk) {
+        size_t count = std::min(chunk, size - first);
+        for (size_t i = 0; i < count; i++) col[i] = value_a(first + i);
+        f(col.data(), count);
+    }
 }
 
 int main(int argc, char** argv) {
@@ -186,6 +179,15 @@ int main(int argc, char** argv) {
     parser.addSwitch("--file_path", "-p", "file path string", "");
     parser.addSwitch("--input_file", "-f", "input file string", "");
     parser.addSwitch("--device", "-d", "device id", "0");
+    parser.addSwitch("--size", "-n", "number of ints in A, B and C", "4096");
+    parser.addSwitch("--chunk", "-c", "ints per P2P buffer (whole 4 KB pages)", "1048576");
+    parser.addSwitch("--depth", "-q", "P2P buffers in flight", "3");
+    parser.addSwitch("--io", "-u", "NVMe I/O backend : uring | sync", "uring");
+    parser.addSwitch("--kernel", "-k", "operator : adder | filter | aggregate | histogram", "adder");
+    parser.addSwitch("--lo", "-l", "filter / aggregate : lowest value kept, histogram : first bin", "100");
+    parser.addSwitch("--hi", "-m", "filter / aggregate : highest value kept", "199");
+    parser.addSwitch("--bins", "-b", "histogram bins", "16");
+    parser.addSwitch("--width", "-w", "histogram bin width", "50");
     parser.parse(argc, argv);
 
     // Read settings
@@ -193,6 +195,16 @@ int main(int argc, char** argv) {
     std::string filepath = parser.value("file_path");
     std::string dev_id = parser.value("device");
     std::string filename;
+    size_t size = std::stoull(parser.value("size"));
+    size_t chunk = std::stoull(parser.value("chunk"));
+    int depth = parser.value_to_int("depth");
+    std::string kernel = parser.value("kernel");
+    int lo = parser.value_to_int("lo");
+    int hi = parser.value_to_int("hi");
+    int nbins = parser.value_to_int("bins");
+    int width = parser.value_to_int("width");
+    std::string reason;
+    std::unique_ptr<NvmeIo> io = make_nvme_io(parser.value("io"), reason);
 
     if (argc < 5) {
         parser.printHelp();
@@ -208,30 +220,47 @@ int main(int argc, char** argv) {
         filename = filepath;
     }
 
-    int nvmeFd1 = -1, nvmeFd2 = -1, nvmeFd3 = -1;
+    if (size == 0 || chunk == 0 || chunk * sizeof(int) % PAGE_SIZE != 0 || depth < 1) {
+        std::cout << "-n must be > 0, -c a multiple of " << PAGE_SIZE / sizeof(int) << " ints and -q >= 1\n";
+        return EXIT_FAILURE;
+    }
+    chunk = std::min(chunk, page_align(size * sizeof(int)) / sizeof(int));
+    if (!io) {
+        std::cout << "Unknown I/O backend " << parser.value("io") << ", use uring or sync\n";
+        return EXIT_FAILURE;
+    }
+    if (!reason.empty()) std::cout << "WARNING: io_uring is not available (" << reason << "), using sync I/O\n";
+    if (nbins < 1 || nbins > histogram_max_bins || width < 1) {
+        std::cout << "-b must be in [1, " << histogram_max_bins << "] and -w >= 1\n";
+        return EXIT_FAILURE;
+    }
+
+    // A.txt, B.txt and C.txt live on the SSD mount, /mnt/csd0 unless -p / -f names a directory
+    std::string dir = filename.empty() ? "/mnt/csd0" : filename;
+    std::string pathA = dir + "/A.txt", pathB = dir + "/B.txt", pathC = dir + "/C.txt", pathS = dir + "/S.txt";
+
+    // filter, aggregate and histogram run on column A
+    Aggregate agg;
+    Histogram hist(lo, width, nbins);
+    StreamOp op;
+    if (kernel == "adder")
+        op = adder_op(dir);
+    else if (kernel == "filter")
+        op = filter_op(pathA, pathS, lo, hi);
+    else if (kernel == "aggregate")
+        op = aggregate_op(pathA, lo, hi, agg);
+    else if (kernel == "histogram")
+        op = histogram_op(pathA, hist);
+    else {
+        std::cout << "Unknown operator " << kernel << ", use adder, filter, aggregate or histogram\n";
+        return EXIT_FAILURE;
+    }
+
+    int nvmeFd1 = -1, nvmeFd2 = -1;
 
     cl_int err;
     cl::Context context;
     cl::CommandQueue q;
-    std::vector<int, aligned_allocator<int> > source_input_A(DATA_SIZE, 3);
-    std::vector<int, aligned_allocator<int> > source_input_B(DATA_SIZE, 4);
-
-    /*
-    std::srand(unsigned(std::time(0)));
-    std::vector<int, aligned_allocator<int>> source_input_A(DATA_SIZE);
-    std::generate(source_input_A.begin(), source_input_A.end(), std::rand);
-    std::vector<int, aligned_allocator<int>> source_input_B(DATA_SIZE);
-    std::generate(source_input_B.begin(), source_input_B.end(), std::rand);
-
-*/
-    std::vector<int, aligned_allocator<int> > source_sw_results(DATA_SIZE);
-    std::vector<int, aligned_allocator<int> > source_hw_results(DATA_SIZE);
-
-    // Create the test data and Software Result
-    for (int i = 0; i < DATA_SIZE; i++) {
-    	// (A + B) + (A + B) = 2A + 2B
-    	source_sw_results[i] = source_input_A[i] + source_input_B[i];
-    }
 
     // OPENCL HOST CODE AREA START
     // get_xil_devices() is a utility API which will find the xilinx
@@ -281,6 +310,10 @@ int main(int argc, char** argv) {
     } else
         std::cout << "Device[" << dev_id << "]: program successful!\n";
 
+    // All P2P buffers of the run are slices of one aperture, reserved and mapped once
+    P2PPool pool(context, q, std::max(2 * sizeof(int) * chunk, StreamRunner::pool_bytes(op, chunk, depth)));
+    std::cout << "INFO: P2P pool of " << pool.capacity() << " bytes" << std::endl;
+
     // P2P transfer from host to SSD
     std::cout << "############################################################\n";
     std::cout << "                  Writing data to SSD                       \n";
@@ -288,18 +321,18 @@ int main(int argc, char** argv) {
     // Get access to the NVMe SSD.
     // /dev/nvme0n1 /mnt/csd0/a.txt
 
-    nvmeFd1 = open("/mnt/csd0/A.txt", O_RDWR | O_DIRECT | O_CREAT, 777);
+    nvmeFd1 = open(pathA.c_str(), O_RDWR | O_DIRECT | O_CREAT, 0777);
     if (nvmeFd1 < 0) {
-    	std::cerr << "ERROR: open " << "/mnt/csd0/A.txt " << "failed: " << std::endl;
+    	std::cerr << "ERROR: open " << pathA << " failed: " << strerror(errno) << std::endl;
     	return EXIT_FAILURE;
     }
-    nvmeFd2 = open("/mnt/csd0/B.txt", O_RDWR | O_DIRECT | O_CREAT, 777);
+    nvmeFd2 = open(pathB.c_str(), O_RDWR | O_DIRECT | O_CREAT, 0777);
     if (nvmeFd2 < 0) {
-    	std::cerr << "ERROR: open " << "/mnt/csd0/B.txt " << "failed: " << std::endl;
+    	std::cerr << "ERROR: open " << pathB << " failed: " << strerror(errno) << std::endl;
     	return EXIT_FAILURE;
     }
-    std::cout << "INFO: Successfully opened NVME SSD " << "/mnt/csd0/A.txt, /mnt/csd0/B.txt" << std::endl;
-    p2p_host_to_ssd(nvmeFd1, nvmeFd2, context, q, program, source_input_A, source_input_B);
+    std::cout << "INFO: Successfully opened NVME SSD " << pathA << ", " << pathB << std::endl;
+    p2p_host_to_ssd(nvmeFd1, nvmeFd2, pool, size, chunk);
     (void)close(nvmeFd1); (void)close(nvmeFd2);
 
 
@@ -308,67 +341,29 @@ int main(int argc, char** argv) {
     std::cout << "                  Reading data from SSD                       \n";
     std::cout << "############################################################\n";
 
-    nvmeFd1 = open("/mnt/csd0/A.txt", O_RDWR | O_DIRECT | O_CREAT, 777);
-    if (nvmeFd1 < 0) {
-    	std::cerr << "ERROR: open " << "/mnt/csd0/A.txt " << "failed: " << std::endl;
-    	return EXIT_FAILURE;
-    }
-    nvmeFd2 = open("/mnt/csd0/B.txt", O_RDWR | O_DIRECT | O_CREAT, 777);
-    if (nvmeFd2 < 0) {
-        std::cerr << "ERROR: open " << "/mnt/csd0/B.txt " << "failed: " << std::endl;
-        return EXIT_FAILURE;
-    }
-    nvmeFd3 = open("/mnt/csd0/C.txt", O_RDWR | O_DIRECT | O_CREAT, 777);
-    if (nvmeFd3 < 0) {
-    	std::cerr << "ERROR: open " << "/mnt/csd0/C.txt " << "failed: " << std::endl;
-        return EXIT_FAILURE;
-    }
-    std::cout << "INFO: Successfully opened NVME SSD " << "/mnt/csd0/A.txt, /mnt/csd0/B.txt, /mnt/csd0/C.txt" << std::endl;
+    StreamRunner runner(q, program, pool, *io);
+    p2p_ssd_to_host(runner, op, size, chunk, depth);
 
     bool num_matched = true;
-    p2p_ssd_to_host(nvmeFd1, nvmeFd2, nvmeFd3, context, q, program, &source_hw_results);
-
-    // Validating the results
-    if (memcmp(static_cast<void*>(source_sw_results.data()), static_cast<void*>(source_hw_results.data()), DATA_SIZE) !=
-        0) {
-        num_matched = false;
-    }
-
-    (void)close(nvmeFd1); (void)close(nvmeFd2); (void)close(nvmeFd3);
-
-
-    std::cout << "Check the C.txt";
-    std::vector<int, aligned_allocator<int>> source_file_results(DATA_SIZE);
-    size_t vector_size_bytes = sizeof(int) * DATA_SIZE;
-    cl_mem_ext_ptr_t inExt1 = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
-
-    OCL_CHECK(err, cl::Buffer buffer_check(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX, vector_size_bytes, &inExt1,
-                                               &err));
-    void* check = q.enqueueMapBuffer(buffer_check, CL_TRUE, CL_MAP_WRITE | CL_MAP_READ, 0, vector_size_bytes,
-                                                nullptr, nullptr, &err);
-
-
-    nvmeFd3 = open("/mnt/csd0/C.txt", O_RDWR | O_DIRECT);
-    if (nvmeFd3 < 0) {
-    	std::cerr << "ERROR: open " << "/mnt/csd0/C.txt " << "failed: " << std::endl;
-    	return EXIT_FAILURE;
-    }
-
-    if (pread(nvmeFd3, check, vector_size_bytes, 0) <= 0) {
-    	std::cerr << "ERR: pread 3 failed: " << " error: " << strerror(errno) << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_check, CL_TRUE, 0, vector_size_bytes, source_file_results.data(),
-                                                    nullptr, nullptr));
-
-    for(int i = 0; i < DATA_SIZE; i++){
-       	if(i % 256 == 0) std::cout << '\n';
-       	std::cout << source_file_results[i] << ' ';
+    if (kernel == "adder") {
+        num_matched = check_sum(pathC, size, chunk);
+    } else if (kernel == "filter") {
+        num_matched = check_filter(pathS, size, lo, hi);
+    } else if (kernel == "aggregate") {
+        Aggregate gold;
+        for_each_chunk_a(size, chunk, [&](const int* col, size_t n) { aggregate_cpu(col, n, lo, hi, gold); });
+        std::cout << "sum " << agg.sum << " count " << agg.count << " min " << agg.min << " max " << agg.max << "\n";
+        num_matched = agg == gold;
+    } else {
+        Histogram gold(lo, width, nbins);
+        for_each_chunk_a(size, chunk, [&](const int* col, size_t n) { histogram_cpu(col, n, gold); });
+        for (int b = 0; b < nbins; b++)
+            std::cout << "[" << lo + (long long)b * width << ", " << lo + (long long)(b + 1) * width << ") "
+                      << hist.bins[b] << "\n";
+        std::cout << "below " << hist.bins[nbins] << " above " << hist.bins[nbins + 1] << "\n";
+        num_matched = hist.bins == gold.bins;
     }
 
-
-    (void)close(nvmeFd3);
-
     std::cout << "\nTEST " << (num_matched ? "PASSED" : "FAILED") << std::endl;
     return (num_matched ? EXIT_SUCCESS : EXIT_FAILURE);
 }
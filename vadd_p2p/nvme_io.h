@@ -0,0 +1,450 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+ * Asynchronous NVMe I/O for the P2P host paths.
+ *
+ * NvmeIo queues aligned reads and writes, submit() hands them to the kernel
+ * and reap() returns the finished ones by tag, so the caller can drive its
+ * pipeline from completions instead of blocking in one pread at a time.
+ *   SyncIo  : pread / pwrite at submit(), queue depth 1, runs anywhere
+ *   UringIo : io_uring through the raw system calls (no liburing needed),
+ *             every request is split into io_block pieces so one P2P buffer
+ *             alone already keeps many commands in flight on the drive.
+ *             Files and buffers can be registered : the fds are then looked
+ *             up once instead of per request and READ_FIXED / WRITE_FIXED
+ *             skip pinning the pages on every request. P2P windows that the
+ *             kernel refuses to register fall back to plain READ / WRITE.
+ * Both work on a regular file of a local filesystem as well as on the SSD.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <linux/io_uring.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+// O_DIRECT transfers are whole pages
+#define PAGE_SIZE 4096
+
+inline size_t page_align(size_t bytes) {
+    return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+// pread / pwrite until done, O_DIRECT may come back short. full_pread returns
+// the bytes read, fewer than asked at the end of the file, -1 on an error.
+inline ssize_t full_pread(int fd, void* buf, size_t bytes, off_t offset) {
+    char* p = static_cast<char*>(buf);
+    while (bytes) {
+        ssize_t ret = pread(fd, p, bytes, offset);
+        if (ret < 0) return -1;
+        if (ret == 0) break;
+        p += ret;
+        bytes -= ret;
+        offset += ret;
+    }
+    return p - static_cast<char*>(buf);
+}
+
+inline bool full_pwrite(int fd, const void* buf, size_t bytes, off_t offset) {
+    const char* p = static_cast<const char*>(buf);
+    while (bytes) {
+        ssize_t ret = pwrite(fd, p, bytes, offset);
+        if (ret <= 0) return false;
+        p += ret;
+        bytes -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+// A finished request : res is the byte count (short only at the end of the file), or -errno
+struct IoDone {
+    uint64_t tag;
+    long res;
+};
+
+class NvmeIo {
+   public:
+    virtual ~NvmeIo() {}
+    virtual const char* name() const = 0;
+
+    // The files and buffers every later request uses. Returns false if the
+    // backend does not (or could not) register them, requests still work.
+    virtual bool register_files(const std::vector<int>&) { return false; }
+    virtual bool register_buffers(const std::vector<iovec>&) { return false; }
+    virtual void unregister() {}
+
+    // Queue a transfer of bytes (> 0) at offset, nothing reaches the drive before submit()
+    virtual void read(int fd, void* buf, size_t bytes, off_t offset, uint64_t tag) = 0;
+    virtual void write(int fd, const void* buf, size_t bytes, off_t offset, uint64_t tag) = 0;
+    virtual void submit() = 0;
+
+    // Appends the finished requests to done, waits for at least one if wait is set
+    virtual void reap(std::vector<IoDone>& done, bool wait) = 0;
+
+    // Requests queued or submitted and not reaped yet
+    virtual size_t in_flight() const = 0;
+};
+
+class SyncIo : public NvmeIo {
+   public:
+    const char* name() const override { return "sync"; }
+
+    void read(int fd, void* buf, size_t bytes, off_t offset, uint64_t tag) override {
+        queued_.push_back({fd, static_cast<char*>(buf), bytes, offset, tag, false});
+    }
+    void write(int fd, const void* buf, size_t bytes, off_t offset, uint64_t tag) override {
+        queued_.push_back({fd, const_cast<char*>(static_cast<const char*>(buf)), bytes, offset, tag, true});
+    }
+
+    void submit() override {
+        for (const Request& r : queued_) {
+            long res = 0;
+            while ((size_t)res < r.bytes) {
+                ssize_t ret = r.is_write ? pwrite(r.fd, r.buf + res, r.bytes - res, r.offset + res)
+                                         : pread(r.fd, r.buf + res, r.bytes - res, r.offset + res);
+                if (ret < 0) res = -errno;
+                if (ret <= 0) break;
+                res += ret;
+            }
+            done_.push_back({r.tag, res});
+        }
+        queued_.clear();
+    }
+
+    void reap(std::vector<IoDone>& done, bool wait) override {
+        if (wait && done_.empty()) submit();
+        done.insert(done.end(), done_.begin(), done_.end());
+        done_.clear();
+    }
+
+    size_t in_flight() const override { return queued_.size() + done_.size(); }
+
+   private:
+    struct Request {
+        int fd;
+        char* buf;
+        size_t bytes;
+        off_t offset;
+        uint64_t tag;
+        bool is_write;
+    };
+    std::vector<Request> queued_;
+    std::vector<IoDone> done_;
+};
+
+class UringIo : public NvmeIo {
+   public:
+    // Pieces larger than io_block are split, entries is the ring size
+    explicit UringIo(size_t io_block = 1 << 20, unsigned entries = 256) : io_block_(io_block) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        ring_fd_ = syscall(__NR_io_uring_setup, entries, &p);
+        if (ring_fd_ < 0) {
+            error_ = std::string("io_uring_setup: ") + strerror(errno);
+            return;
+        }
+
+        sq_bytes_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_bytes_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        sqes_bytes_ = p.sq_entries * sizeof(io_uring_sqe);
+        sq_ = (char*)mmap(nullptr, sq_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                          IORING_OFF_SQ_RING);
+        cq_ = (char*)mmap(nullptr, cq_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                          IORING_OFF_CQ_RING);
+        sqes_ = (io_uring_sqe*)mmap(nullptr, sqes_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ring_fd_, IORING_OFF_SQES);
+        if (sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            error_ = std::string("io_uring mmap: ") + strerror(errno);
+            return;
+        }
+
+        sq_head_ = (unsigned*)(sq_ + p.sq_off.head);
+        sq_tail_ = (unsigned*)(sq_ + p.sq_off.tail);
+        sq_mask_ = *(unsigned*)(sq_ + p.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq_ + p.sq_off.array);
+        sq_entries_ = p.sq_entries;
+        cq_head_ = (unsigned*)(cq_ + p.cq_off.head);
+        cq_tail_ = (unsigned*)(cq_ + p.cq_off.tail);
+        cq_mask_ = *(unsigned*)(cq_ + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq_ + p.cq_off.cqes);
+
+        // READ / WRITE came after io_uring itself (5.6, like the probe) : a
+        // ring without them has nothing to run the plain requests on
+        if (!supports({IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED}))
+            error_ = "io_uring : no READ / WRITE opcodes in this kernel";
+    }
+
+    ~UringIo() override {
+        if (sqes_ && sqes_ != MAP_FAILED) munmap(sqes_, sqes_bytes_);
+        if (cq_ && cq_ != MAP_FAILED) munmap(cq_, cq_bytes_);
+        if (sq_ && sq_ != MAP_FAILED) munmap(sq_, sq_bytes_);
+        if (ring_fd_ >= 0) close(ring_fd_);
+    }
+
+    // Empty when the ring is usable
+    const std::string& error() const { return error_; }
+    const char* name() const override { return "io_uring"; }
+
+    bool register_files(const std::vector<int>& fds) override {
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES, fds.data(), fds.size()) < 0)
+            return false;
+        files_ = fds;
+        return true;
+    }
+
+    bool register_buffers(const std::vector<iovec>& bufs) override {
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, bufs.data(), bufs.size()) < 0)
+            return false;
+        bufs_ = bufs;
+        return true;
+    }
+
+    void unregister() override {
+        if (!files_.empty()) syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_FILES, nullptr, 0);
+        if (!bufs_.empty()) syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        files_.clear();
+        bufs_.clear();
+    }
+
+    void read(int fd, void* buf, size_t bytes, off_t offset, uint64_t tag) override {
+        queue(fd, static_cast<char*>(buf), bytes, offset, tag, false);
+    }
+    void write(int fd, const void* buf, size_t bytes, off_t offset, uint64_t tag) override {
+        queue(fd, const_cast<char*>(static_cast<const char*>(buf)), bytes, offset, tag, true);
+    }
+
+    // Moves as many pieces as the ring has room for into the SQ and enters the kernel.
+    // At most sq_entries pieces are in the kernel, so the CQ can never overflow.
+    void submit() override {
+        if (enter_error_) return;
+        unsigned tail = *sq_tail_;
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        unsigned added = 0;
+
+        while (!pending_.empty() && tail - head < sq_entries_ && submitted_ < sq_entries_) {
+            size_t id = pending_.front();
+            pending_.pop_front();
+            prepare(&sqes_[tail & sq_mask_], id);
+            sq_array_[tail & sq_mask_] = tail & sq_mask_;
+            tail++;
+            added++;
+            submitted_++;
+        }
+        if (!added) return;
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        enter(added, 0, 0);
+    }
+
+    void reap(std::vector<IoDone>& done, bool wait) override {
+        size_t before = done.size();
+        for (;;) {
+            if (enter_error_) {
+                fail_all(done);
+                return;
+            }
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) finish(cqes_[head & cq_mask_], done);
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+            // short transfers were put back on pending_ by finish()
+            if (!pending_.empty()) submit();
+            if (!wait || done.size() > before || pieces_ == 0) return;
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+
+    size_t in_flight() const override { return requests_; }
+
+   private:
+    // One io_block piece of a request
+    struct Piece {
+        int fd;
+        char* buf;
+        size_t bytes;
+        off_t offset;
+        size_t request;
+        bool is_write;
+    };
+    struct Request {
+        uint64_t tag;
+        size_t left;
+        long res;
+    };
+
+    void queue(int fd, char* buf, size_t bytes, off_t offset, uint64_t tag, bool is_write) {
+        size_t request = slot(request_ids_, requests_pool_);
+        requests_pool_[request] = {tag, 0, 0};
+        for (size_t done = 0; done < bytes; done += io_block_) {
+            size_t n = bytes - done < io_block_ ? bytes - done : io_block_;
+            size_t id = slot(piece_ids_, pieces_pool_);
+            pieces_pool_[id] = {fd, buf + done, n, offset + (off_t)done, request, is_write};
+            pending_.push_back(id);
+            requests_pool_[request].left++;
+            pieces_++;
+        }
+        requests_++;
+    }
+
+    // Free list allocation, ids stay valid while the pool grows
+    template <typename T>
+    static size_t slot(std::vector<size_t>& free_ids, std::vector<T>& pool) {
+        if (free_ids.empty()) {
+            pool.emplace_back();
+            return pool.size() - 1;
+        }
+        size_t id = free_ids.back();
+        free_ids.pop_back();
+        return id;
+    }
+
+    void prepare(io_uring_sqe* sqe, size_t id) {
+        const Piece& p = pieces_pool_[id];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = p.is_write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = p.fd;
+        sqe->addr = (uint64_t)p.buf;
+        sqe->len = p.bytes;
+        sqe->off = p.offset;
+        sqe->user_data = id;
+
+        for (size_t f = 0; f < files_.size(); f++) {
+            if (files_[f] == p.fd) {
+                sqe->fd = f;
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+        }
+        for (size_t b = 0; b < bufs_.size(); b++) {
+            char* base = static_cast<char*>(bufs_[b].iov_base);
+            if (p.buf >= base && p.buf + p.bytes <= base + bufs_[b].iov_len) {
+                sqe->opcode = p.is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe->buf_index = b;
+                break;
+            }
+        }
+    }
+
+    bool supports(const std::vector<int>& ops) {
+        std::vector<char> mem(sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(mem.data());
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+            return false;
+        for (int op : ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    void finish(const io_uring_cqe& cqe, std::vector<IoDone>& done) {
+        size_t id = cqe.user_data;
+        Piece& p = pieces_pool_[id];
+        submitted_--;
+        Request& r = requests_pool_[p.request];
+
+        if (cqe.res > 0 && (size_t)cqe.res < p.bytes) {
+            // short transfer, the rest goes out again as a new piece
+            p.buf += cqe.res;
+            p.bytes -= cqe.res;
+            p.offset += cqe.res;
+            r.res += cqe.res;
+            pending_.push_back(id);
+            return;
+        }
+        if (cqe.res < 0 && r.res >= 0) r.res = cqe.res;
+        if (cqe.res > 0 && r.res >= 0) r.res += cqe.res;
+
+        piece_ids_.push_back(id);
+        pieces_--;
+        if (--r.left == 0) {
+            done.push_back({r.tag, r.res});
+            request_ids_.push_back(p.request);
+            requests_--;
+        }
+    }
+
+    // Any error but EINTR leaves the ring in an unknown state : it is kept in
+    // enter_error_ and the next reap() fails every open request with it.
+    void enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        while (syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0) < 0) {
+            if (errno != EINTR) {
+                enter_error_ = -errno;
+                return;
+            }
+        }
+    }
+
+    void fail_all(std::vector<IoDone>& done) {
+        for (const Request& r : requests_pool_) {
+            if (r.left) done.push_back({r.tag, enter_error_});
+        }
+        pieces_pool_.clear();
+        piece_ids_.clear();
+        requests_pool_.clear();
+        request_ids_.clear();
+        pending_.clear();
+        pieces_ = requests_ = submitted_ = 0;
+    }
+
+    size_t io_block_;
+    int ring_fd_ = -1;
+    std::string error_;
+
+    char* sq_ = nullptr;
+    char* cq_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sq_bytes_ = 0, cq_bytes_ = 0, sqes_bytes_ = 0;
+    unsigned *sq_head_, *sq_tail_, *sq_array_, sq_mask_, sq_entries_;
+    unsigned *cq_head_, *cq_tail_, cq_mask_;
+    io_uring_cqe* cqes_;
+
+    std::vector<int> files_;
+    std::vector<iovec> bufs_;
+    std::vector<Piece> pieces_pool_;
+    std::vector<size_t> piece_ids_;
+    std::vector<Request> requests_pool_;
+    std::vector<size_t> request_ids_;
+    std::deque<size_t> pending_;
+    size_t pieces_ = 0;
+    size_t requests_ = 0;
+    unsigned submitted_ = 0;
+    long enter_error_ = 0;
+};
+
+// "sync" or "uring", nullptr for an unknown name. A ring that cannot be set up
+// (old kernel, seccomp) or lacks the READ / WRITE opcodes falls back to sync
+// with a warning in reason.
+inline std::unique_ptr<NvmeIo> make_nvme_io(const std::string& name, std::string& reason) {
+    if (name == "sync") return std::unique_ptr<NvmeIo>(new SyncIo());
+    if (name != "uring") return nullptr;
+
+    std::unique_ptr<UringIo> uring(new UringIo());
+    if (!uring->error().empty()) {
+        reason = uring->error();
+        return std::unique_ptr<NvmeIo>(new SyncIo());
+    }
+    return uring;
+}
@@ -0,0 +1,127 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+ * Pool of P2P memory for the SmartSSD host code.
+ *
+ * Creating and mapping a P2P buffer costs a round trip through the driver
+ * each time and every new buffer takes its own piece of the P2P BAR window.
+ * P2PPool reserves the aperture once as a single P2P buffer, maps it once,
+ * and hands out slices : a sub-buffer for the kernel arguments plus the host
+ * pointer into the existing mapping for pread / pwrite. Slices start on
+ * align byte boundaries (whole pages for O_DIRECT) and release() puts them
+ * back on a first fit free list whose neighbours are merged, so a streaming
+ * loop never creates or maps a buffer on its hot path.
+ */
+
+#pragma once
+
+#include "xcl2.hpp"
+#include <iterator>
+#include <map>
+
+struct P2PSlice {
+    cl::Buffer buffer;
+    char* ptr = nullptr;
+    size_t offset = 0;
+    size_t bytes = 0;
+
+    template <typename T>
+    T* as() const {
+        return reinterpret_cast<T*>(ptr);
+    }
+};
+
+class P2PPool {
+   public:
+    P2PPool(const cl::Context& context, const cl::CommandQueue& q, size_t bytes, size_t align = 4096)
+        : q_(q), align_(align), bytes_(round(bytes)) {
+        cl_int err;
+        cl_mem_ext_ptr_t ext = {XCL_MEM_EXT_P2P_BUFFER, nullptr, 0};
+
+        OCL_CHECK(err, pool_ = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, bytes_, &ext, &err));
+        OCL_CHECK(err, base_ = (char*)q_.enqueueMapBuffer(pool_, CL_TRUE, CL_MAP_WRITE | CL_MAP_READ, 0, bytes_,
+                                                          nullptr, nullptr, &err));
+        free_[0] = bytes_;
+    }
+
+    ~P2PPool() {
+        q_.enqueueUnmapMemObject(pool_, base_);
+        q_.finish();
+    }
+
+    P2PPool(const P2PPool&) = delete;
+    P2PPool& operator=(const P2PPool&) = delete;
+
+    // A slice of at least bytes, false when no free range is large enough
+    bool allocate(size_t bytes, cl_mem_flags flags, P2PSlice& slice) {
+        size_t need = round(bytes);
+        for (auto it = free_.begin(); it != free_.end(); ++it) {
+            if (it->second < need) continue;
+
+            size_t offset = it->first;
+            size_t left = it->second - need;
+            free_.erase(it);
+            if (left) free_[offset + need] = left;
+
+            cl_int err;
+            cl_buffer_region region = {offset, need};
+            OCL_CHECK(err, slice.buffer = pool_.createSubBuffer(flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+            slice.ptr = base_ + offset;
+            slice.offset = offset;
+            slice.bytes = need;
+            used_ += need;
+            return true;
+        }
+        return false;
+    }
+
+    void release(P2PSlice& slice) {
+        if (!slice.ptr) return;
+        auto next = free_.emplace(slice.offset, slice.bytes).first;
+        used_ -= slice.bytes;
+
+        // merge with the free ranges on either side
+        auto after = std::next(next);
+        if (after != free_.end() && next->first + next->second == after->first) {
+            next->second += after->second;
+            free_.erase(after);
+        }
+        if (next != free_.begin()) {
+            auto before = std::prev(next);
+            if (before->first + before->second == next->first) {
+                before->second += next->second;
+                free_.erase(next);
+            }
+        }
+        slice = P2PSlice();
+    }
+
+    size_t capacity() const { return bytes_; }
+    size_t used() const { return used_; }
+
+   private:
+    size_t round(size_t bytes) const { return (bytes + align_ - 1) / align_ * align_; }
+
+    cl::CommandQueue q_;
+    size_t align_;
+    size_t bytes_;
+    size_t used_ = 0;
+    cl::Buffer pool_;
+    char* base_ = nullptr;
+    // offset -> bytes of every free range
+    std::map<size_t, size_t> free_;
+};
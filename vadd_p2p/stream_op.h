@@ -0,0 +1,402 @@
+/**
+* Copyright (C) 2019-2021 Xilinx, Inc
+*
+* Licensed under the Apache License, Version 2.0 (the "License"). You may
+* not use this file except in compliance with the License. A copy of the
+* License is located at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+* WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+* License for the specific language governing permissions and limitations
+* under the License.
+*/
+
+/*
+ * Near-storage streaming operators.
+ *
+ * A StreamOp names a kernel and declares the files it reads and writes;
+ * StreamRunner streams the inputs from the SSD into P2P slices, runs the
+ * kernel on every chunk and sends the outputs back, with depth chunks in
+ * flight (read chunk k + 1 / kernel on chunk k / write chunk k - 1).
+ *
+ * Kernel arguments, in this order :
+ *   one buffer per input                    count elements of elem_bytes
+ *   per output :
+ *     elements   one buffer                 count elements, written back at the
+ *                                           same element offset as the inputs
+ *     compacted  data buffer + int* kept    the kernel keeps kept[0] <= count
+ *                                           elements, appended to the file in order
+ *     reduced    one buffer                 reduce_bytes per chunk, handed to
+ *                                           combine() on the host, no file
+ *   int count                               elements in this chunk
+ *   long long first                         only with op.pass_first : index of
+ *                                           the chunk's first element in the files
+ *   op.scalars(krnl, index)                 any further arguments, set once
+ * so an elementwise transform, a filter or a reduction is a descriptor and a
+ * kernel, not a new host program.
+ *
+ * Compacted outputs go through a host staging buffer : O_DIRECT only writes
+ * whole pages, so only full pages go out while the stream runs and the tail
+ * is written and the file trimmed at the end.
+ *
+ * The host never reads results through the P2P mapping, an uncached PCIe BAR
+ * window meant for the SSD : the kept counts and reductions are read back by
+ * DMA right behind the kernel, the compacted rows once their count is known.
+ */
+
+#pragma once
+
+#include "nvme_io.h"
+#include "p2p_pool.h"
+#include "xcl2.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct StreamPort {
+    enum Kind { elements, compacted, reduced };
+
+    std::string path;
+    size_t elem_bytes = sizeof(int);
+    Kind kind = elements;
+    // reduced : bytes the kernel writes per chunk and how the host folds them
+    size_t reduce_bytes = 0;
+    std::function<void(const char*)> combine = nullptr;
+};
+
+struct StreamOp {
+    std::string kernel;
+    std::vector<StreamPort> inputs;
+    std::vector<StreamPort> outputs;
+    bool pass_first = false;
+    std::function<void(cl::Kernel&, int)> scalars;
+};
+
+struct StreamStats {
+    double seconds = 0;
+    size_t bytes_in = 0;
+    size_t bytes_out = 0;
+    // elements written per output, reduced outputs stay 0
+    std::vector<size_t> out_elements;
+};
+
+class StreamRunner {
+   public:
+    StreamRunner(const cl::CommandQueue& q, const cl::Program& program, P2PPool& pool, NvmeIo& io)
+        : q_(q), program_(program), pool_(pool), io_(io) {}
+
+    // P2P bytes run() needs for op with depth chunks of chunk elements in flight
+    static size_t pool_bytes(const StreamOp& op, size_t chunk, int depth) {
+        size_t slot = 0;
+        for (const StreamPort& p : op.inputs) slot += page_align(chunk * p.elem_bytes);
+        for (const StreamPort& p : op.outputs) {
+            if (p.kind == StreamPort::reduced)
+                slot += page_align(p.reduce_bytes);
+            else
+                slot += page_align(chunk * p.elem_bytes);
+            if (p.kind == StreamPort::compacted) slot += PAGE_SIZE;
+        }
+        return slot * depth;
+    }
+
+    // Streams elements [0, size) of the inputs through op, exits on an I/O or OpenCL error
+    StreamStats run(const StreamOp& op, size_t size, size_t chunk, int depth) {
+        cl_int err;
+        std::vector<Slot> slots(depth);
+        std::vector<iovec> windows;
+        StreamStats stats;
+        stats.out_elements.assign(op.outputs.size(), 0);
+
+        // every chunk has to start on a page of every file
+        std::vector<StreamPort> ports = op.inputs;
+        ports.insert(ports.end(), op.outputs.begin(), op.outputs.end());
+        for (const StreamPort& p : ports) {
+            if (p.kind == StreamPort::elements && chunk * p.elem_bytes % PAGE_SIZE) {
+                std::cerr << "ERROR: chunks of " << chunk << " elements do not start on a page of " << p.path
+                          << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (op.inputs.size() > 64 || op.outputs.size() > 64) {
+            std::cerr << "ERROR: " << op.kernel << " has more than 64 inputs or outputs" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::vector<int> in_fds, out_fds, fds;
+        for (const StreamPort& p : op.inputs) in_fds.push_back(open_port(p.path, O_RDONLY | O_DIRECT));
+        for (const StreamPort& p : op.outputs)
+            out_fds.push_back(p.kind == StreamPort::reduced
+                                  ? -1
+                                  : open_port(p.path, O_RDWR | O_DIRECT | O_CREAT | O_TRUNC));
+        for (int fd : in_fds) fds.push_back(fd);
+        for (int fd : out_fds)
+            if (fd >= 0) fds.push_back(fd);
+
+        for (Slot& s : slots) {
+            s.in.resize(op.inputs.size());
+            s.out.resize(op.outputs.size());
+            s.kept.resize(op.outputs.size());
+            s.kept_count.assign(op.outputs.size(), 0);
+            s.result.resize(op.outputs.size());
+            OCL_CHECK(err, s.krnl = cl::Kernel(program_, op.kernel.c_str(), &err));
+
+            int arg = 0;
+            for (size_t i = 0; i < op.inputs.size(); i++) {
+                take(chunk * op.inputs[i].elem_bytes, CL_MEM_READ_ONLY, s.in[i], windows);
+                OCL_CHECK(err, err = s.krnl.setArg(arg++, s.in[i].buffer));
+            }
+            for (size_t o = 0; o < op.outputs.size(); o++) {
+                const StreamPort& p = op.outputs[o];
+                take(p.kind == StreamPort::reduced ? p.reduce_bytes : chunk * p.elem_bytes, CL_MEM_WRITE_ONLY,
+                     s.out[o], windows);
+                OCL_CHECK(err, err = s.krnl.setArg(arg++, s.out[o].buffer));
+                if (p.kind == StreamPort::compacted) {
+                    take(sizeof(int), CL_MEM_WRITE_ONLY, s.kept[o], windows);
+                    OCL_CHECK(err, err = s.krnl.setArg(arg++, s.kept[o].buffer));
+                }
+                if (p.kind != StreamPort::elements)
+                    s.result[o].resize(p.kind == StreamPort::reduced ? p.reduce_bytes : chunk * p.elem_bytes);
+            }
+            s.count_arg = arg++;
+            if (op.pass_first) arg++;
+            if (op.scalars) op.scalars(s.krnl, arg);
+        }
+
+        bool files = io_.register_files(fds);
+        bool buffers = io_.register_buffers(windows);
+        std::cout << "INFO: " << op.kernel << " over " << depth << " buffers of " << chunk << " elements, "
+                  << io_.name() << " I/O, registered files: " << (files ? "yes" : "no")
+                  << ", registered P2P buffers: " << (buffers ? "yes" : "no") << std::endl;
+
+        // compacted outputs : bytes appended so far and the partial page not written yet
+        std::vector<size_t> appended(op.outputs.size(), 0);
+        std::vector<std::vector<char, aligned_allocator<char> > > stage(op.outputs.size());
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::deque<int> running;
+        std::vector<IoDone> done;
+        size_t next = 0, launch = 0, finished = 0;
+
+        while (finished < size) {
+            // Idle slots start reading the next chunks
+            for (int i = 0; i < depth && next < size; i++) {
+                Slot& s = slots[i];
+                if (s.state != Slot::idle) continue;
+                s.first = next;
+                s.count = std::min(chunk, size - next);
+                next += s.count;
+                for (size_t k = 0; k < op.inputs.size(); k++) {
+                    size_t elem = op.inputs[k].elem_bytes;
+                    // the reads start on a page, so chunk * elem_bytes must be whole pages
+                    io_.read(in_fds[k], s.in[k].ptr, page_align(s.count * elem), s.first * elem, i * 64 + k);
+                    stats.bytes_in += s.count * elem;
+                }
+                s.state = Slot::reading;
+                s.pending = op.inputs.size();
+            }
+            io_.submit();
+
+            // Finished kernels hand their outputs on, in queue order
+            bool progress = false;
+            while (!running.empty()) {
+                int i = running.front();
+                Slot& s = slots[i];
+                cl_int status;
+                OCL_CHECK(err, err = s.done.getInfo(CL_EVENT_COMMAND_EXECUTION_STATUS, &status));
+                if (status != CL_COMPLETE) break;
+                running.pop_front();
+                progress = true;
+
+                s.state = Slot::writing;
+                s.pending = 0;
+                for (size_t o = 0; o < op.outputs.size(); o++) {
+                    const StreamPort& p = op.outputs[o];
+                    if (p.kind == StreamPort::elements) {
+                        // the tail of the last chunk is padding, trimmed at the end
+                        io_.write(out_fds[o], s.out[o].ptr, page_align(s.count * p.elem_bytes),
+                                  s.first * p.elem_bytes, i * 64 + o);
+                        s.pending++;
+                        stats.out_elements[o] += s.count;
+                    } else if (p.kind == StreamPort::compacted) {
+                        size_t kept = std::min<size_t>(std::max(s.kept_count[o], 0), s.count);
+                        if (kept) {
+                            OCL_CHECK(err, err = q_.enqueueReadBuffer(s.out[o].buffer, CL_TRUE, 0,
+                                                                      kept * p.elem_bytes, s.result[o].data()));
+                        }
+                        append(out_fds[o], stage[o], appended[o], s.result[o].data(), kept * p.elem_bytes);
+                        stats.out_elements[o] += kept;
+                    } else {
+                        p.combine(s.result[o].data());
+                    }
+                }
+                if (s.pending == 0) {
+                    finished += s.count;
+                    s.state = Slot::idle;
+                }
+            }
+            if (progress) io_.submit();
+
+            // Nothing on the SSD : the oldest kernel is all there is to wait for
+            if (io_.in_flight() == 0) {
+                if (!running.empty()) {
+                    OCL_CHECK(err, err = slots[running.front()].done.wait());
+                }
+                continue;
+            }
+
+            done.clear();
+            io_.reap(done, !progress);
+            for (const IoDone& d : done) {
+                int i = d.tag / 64;
+                Slot& s = slots[i];
+                if (d.res < 0) {
+                    std::cerr << "ERR: P2P " << (s.state == Slot::writing ? "write" : "read")
+                              << " failed: " << " error: " << strerror(-d.res) << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                const StreamPort& port = s.state == Slot::writing ? op.outputs[d.tag % 64] : op.inputs[d.tag % 64];
+                if ((size_t)d.res < s.count * port.elem_bytes) {
+                    std::cerr << "ERR: " << port.path << " ends before element " << s.first + s.count << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                if (--s.pending) continue;
+                if (s.state == Slot::writing) {
+                    finished += s.count;
+                    s.state = Slot::idle;
+                } else {
+                    s.state = Slot::ready;
+                }
+            }
+
+            // Kernels start in file order even when the reads finish out of
+            // order, so compacted outputs are appended in row order
+            for (bool launched = true; launched;) {
+                launched = false;
+                for (int i = 0; i < depth; i++) {
+                    Slot& s = slots[i];
+                    if (s.state != Slot::ready || s.first != launch) continue;
+                    // Launch the Kernel
+                    OCL_CHECK(err, err = s.krnl.setArg(s.count_arg, (int)s.count));
+                    if (op.pass_first) {
+                        OCL_CHECK(err, err = s.krnl.setArg(s.count_arg + 1, (long long)s.first));
+                    }
+                    OCL_CHECK(err, err = q_.enqueueTask(s.krnl, nullptr, &s.done));
+                    // in order queue : s.done ends up the event of the last read back
+                    for (size_t o = 0; o < op.outputs.size(); o++) {
+                        const StreamPort& p = op.outputs[o];
+                        if (p.kind == StreamPort::compacted) {
+                            OCL_CHECK(err, err = q_.enqueueReadBuffer(s.kept[o].buffer, CL_FALSE, 0, sizeof(int),
+                                                                      &s.kept_count[o], nullptr, &s.done));
+                        } else if (p.kind == StreamPort::reduced) {
+                            OCL_CHECK(err, err = q_.enqueueReadBuffer(s.out[o].buffer, CL_FALSE, 0, p.reduce_bytes,
+                                                                      s.result[o].data(), nullptr, &s.done));
+                        }
+                    }
+                    OCL_CHECK(err, err = q_.flush());
+                    s.state = Slot::running;
+                    running.push_back(i);
+                    launch += s.count;
+                    launched = true;
+                }
+            }
+        }
+        q_.finish();
+
+        // Partial pages out, then every file trimmed to its real length
+        for (size_t o = 0; o < op.outputs.size(); o++) {
+            const StreamPort& p = op.outputs[o];
+            if (p.kind == StreamPort::reduced) continue;
+            size_t bytes = stats.out_elements[o] * p.elem_bytes;
+            if (p.kind == StreamPort::compacted && !stage[o].empty()) {
+                size_t tail = stage[o].size();
+                stage[o].resize(PAGE_SIZE, 0);
+                if (!full_pwrite(out_fds[o], stage[o].data(), PAGE_SIZE, appended[o])) {
+                    std::cerr << "ERR: write of " << p.path << " failed: " << strerror(errno) << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                appended[o] += tail;
+            }
+            if (ftruncate(out_fds[o], bytes) != 0) {
+                std::cerr << "ERR: ftruncate of " << p.path << " failed: " << strerror(errno) << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            stats.bytes_out += bytes;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        stats.seconds = elapsed.count();
+
+        io_.unregister();
+        for (int fd : fds) (void)close(fd);
+        for (Slot& s : slots) {
+            for (P2PSlice& in : s.in) pool_.release(in);
+            for (P2PSlice& out : s.out) pool_.release(out);
+            for (P2PSlice& kept : s.kept) pool_.release(kept);
+        }
+        return stats;
+    }
+
+   private:
+    // One chunk in flight : idle -> reading -> ready -> running -> writing -> idle
+    struct Slot {
+        enum State { idle, reading, ready, running, writing };
+
+        std::vector<P2PSlice> in, out, kept;
+        // host copies of the kept counts, and of the compacted rows or reduction of every output
+        std::vector<int> kept_count;
+        std::vector<std::vector<char> > result;
+        cl::Kernel krnl;
+        cl::Event done;
+        int count_arg = 0;
+        State state = idle;
+        size_t pending = 0;
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    static int open_port(const std::string& path, int flags) {
+        int fd = open(path.c_str(), flags, 0777);
+        if (fd < 0) {
+            std::cerr << "ERROR: open " << path << " failed: " << strerror(errno) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        return fd;
+    }
+
+    void take(size_t bytes, cl_mem_flags flags, P2PSlice& slice, std::vector<iovec>& windows) {
+        if (!pool_.allocate(bytes, flags, slice)) {
+            std::cerr << "ERROR: P2P pool of " << pool_.capacity() << " bytes has no room for " << bytes
+                      << " more bytes, " << pool_.used() << " in use" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        windows.push_back({slice.ptr, slice.bytes});
+    }
+
+    // Appends bytes to a compacted output, whole pages go out as soon as they fill up
+    static void append(int fd, std::vector<char, aligned_allocator<char> >& stage, size_t& appended,
+                       const char* data, size_t bytes) {
+        stage.insert(stage.end(), data, data + bytes);
+        size_t whole = stage.size() / PAGE_SIZE * PAGE_SIZE;
+        if (!whole) return;
+        if (!full_pwrite(fd, stage.data(), whole, appended)) {
+            std::cerr << "ERR: compacted write failed: " << strerror(errno) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        appended += whole;
+        stage.erase(stage.begin(), stage.begin() + whole);
+    }
+
+    cl::CommandQueue q_;
+    cl::Program program_;
+    P2PPool& pool_;
+    NvmeIo& io_;
+};